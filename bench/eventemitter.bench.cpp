@@ -0,0 +1,651 @@
+//-----------------------------------------------------------------------------
+//   Copyright 2018 FutoIn Project
+//   Copyright 2018 Andrey Galkin
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//-----------------------------------------------------------------------------
+//! @file
+//! @brief Benchmarks of EventEmitter
+//!
+//! Prints one JSON object per result line: {"bench":"name",...}
+//! Usage: RIAsyncEventBench [scale]
+//-----------------------------------------------------------------------------
+
+#include <futoin/ri/asynctool.hpp>
+#include <futoin/ri/concurrenteventemitter.hpp>
+#include <futoin/ri/eventemitter.hpp>
+//---
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    using futoin::IEventEmitter;
+    using futoin::ri::AsyncTool;
+
+    struct BenchEmitter : futoin::ri::EventEmitter
+    {
+        BenchEmitter(AsyncTool& at) : EventEmitter(at) {}
+
+        using EventEmitter::register_event;
+    };
+
+    struct BenchConcurrentEmitter : futoin::ri::ConcurrentEventEmitter
+    {
+        using ConcurrentEventEmitter::register_event;
+    };
+
+    std::size_t scale = 1;
+    // Shared counter would limit scaling of the benchmark itself
+    thread_local std::size_t thread_deliveries = 0;
+
+    // Single line JSON object
+    class Report
+    {
+    public:
+        Report(const char* bench) noexcept
+        {
+            std::cout << "{\"bench\":\"" << bench << '"';
+        }
+
+        Report(const Report&) = delete;
+        Report& operator=(const Report&) = delete;
+
+        ~Report() noexcept
+        {
+            std::cout << '}' << std::endl;
+        }
+
+        Report& operator()(const char* name, double value) noexcept
+        {
+            std::cout << ",\"" << name << "\":" << value;
+            return *this;
+        }
+
+        Report& operator()(const char* name, const char* value) noexcept
+        {
+            std::cout << ",\"" << name << "\":\"" << value << '"';
+            return *this;
+        }
+
+        Report& rate(std::size_t ops, Clock::duration elapsed) noexcept
+        {
+            const auto ns =
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            elapsed)
+                            .count();
+            (*this)("ops", ops);
+            (*this)("ns_per_op", double(ns) / ops);
+            (*this)("ops_per_sec", ops * 1e9 / std::max<double>(ns, 1));
+            return *this;
+        }
+
+        Report& percentiles(std::vector<Clock::duration>& samples) noexcept
+        {
+            std::sort(samples.begin(), samples.end());
+
+            auto at = [&](double p) {
+                const auto i = std::min<std::size_t>(
+                        samples.size() * p, samples.size() - 1);
+                return double(std::chrono::duration_cast<
+                                      std::chrono::nanoseconds>(samples[i])
+                                      .count());
+            };
+
+            (*this)("samples", samples.size());
+            (*this)("p50_ns", at(0.5));
+            (*this)("p90_ns", at(0.9));
+            (*this)("p99_ns", at(0.99));
+            (*this)("p999_ns", at(0.999));
+            (*this)("max_ns", at(1));
+            return *this;
+        }
+    };
+
+    void run_in_loop(AsyncTool& at, const std::function<void()>& f)
+    {
+        std::promise<void> done;
+        at.immediate([&]() {
+            f();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+
+    // Emits `total` in chunks, so other loop tasks are not starved
+    Clock::duration emit_chunked(
+            AsyncTool& at,
+            std::size_t total,
+            const std::function<void()>& emit,
+            std::size_t chunk = 1000)
+    {
+        std::promise<void> done;
+        std::size_t left = total;
+        std::function<void()> step;
+
+        step = [&]() {
+            if (left == 0) {
+                // NOTE: dispatches of the last chunk are queued before
+                done.set_value();
+                return;
+            }
+
+            for (auto i = std::min(left, chunk); i > 0; --i, --left) {
+                emit();
+            }
+
+            at.immediate(std::ref(step));
+        };
+
+        const auto start = Clock::now();
+        at.immediate(std::ref(step));
+        done.get_future().wait();
+        return Clock::now() - start;
+    }
+
+    void bench_throughput(AsyncTool& at)
+    {
+        const std::size_t total = 1000000 * scale;
+
+        for (auto batch : {1, 0}) {
+            for (auto listeners : {1, 4, 16, 64}) {
+                BenchEmitter ee{at};
+                IEventEmitter::EventType event{"Event"};
+                ee.register_event<int>(event);
+                BenchEmitter::setDispatchBatch(ee, batch);
+                BenchEmitter::setMaxListeners(ee, listeners);
+
+                std::size_t count = 0;
+                std::deque<IEventEmitter::EventHandler> handlers;
+
+                for (auto i = 0; i < listeners; ++i) {
+                    handlers.emplace_back([&](int) { ++count; });
+                    ee.on(event, handlers.back());
+                }
+
+                const auto elapsed =
+                        emit_chunked(at, total, [&]() { ee.emit(event, 1); });
+
+                Report("throughput")("listeners", listeners)(
+                        "dispatch_batch", batch)
+                        .rate(total, elapsed)("deliveries", count);
+
+                for (auto& h : handlers) {
+                    ee.off(event, h);
+                }
+            }
+        }
+    }
+
+    void bench_latency(AsyncTool& at)
+    {
+        const std::size_t total = 100000 * scale;
+
+        BenchEmitter ee{at};
+        IEventEmitter::EventType event{"Event"};
+        ee.register_event<Clock::rep>(event);
+
+        std::vector<Clock::duration> samples;
+        samples.reserve(total);
+
+        IEventEmitter::EventHandler handler([&](Clock::rep emitted) {
+            samples.push_back(
+                    Clock::now() - Clock::time_point(Clock::duration(emitted)));
+        });
+        ee.on(event, handler);
+
+        for (auto inline_emit : {false, true}) {
+            samples.clear();
+
+            // One emit per loop iteration to avoid queueing effects
+            std::promise<void> done;
+            std::size_t left = total;
+            std::function<void()> step;
+
+            step = [&]() {
+                if (left == 0) {
+                    done.set_value();
+                    return;
+                }
+
+                --left;
+
+                const auto now = Clock::now().time_since_epoch().count();
+
+                if (inline_emit) {
+                    ee.emit_now(event, now);
+                } else {
+                    ee.emit(event, now);
+                }
+
+                at.immediate(std::ref(step));
+            };
+
+            at.immediate(std::ref(step));
+            done.get_future().wait();
+
+            Report("latency")("mode", inline_emit ? "emit_now" : "emit")
+                    .percentiles(samples);
+        }
+
+        ee.off(event, handler);
+    }
+
+    void bench_once_churn(AsyncTool& at)
+    {
+        const std::size_t total = 200000 * scale;
+        const std::size_t POOL = 64;
+
+        BenchEmitter ee{at};
+        IEventEmitter::EventType event{"Event"};
+        ee.register_event<int>(event);
+        BenchEmitter::setMaxListeners(ee, POOL);
+
+        std::size_t count = 0;
+        std::deque<IEventEmitter::EventHandler> handlers;
+
+        for (std::size_t i = 0; i < POOL; ++i) {
+            handlers.emplace_back([&](int) { ++count; });
+        }
+
+        // NOTE: one round per chunk to get handlers fired before re-use
+        const auto elapsed = emit_chunked(
+                at,
+                total / POOL,
+                [&]() {
+                    for (auto& h : handlers) {
+                        ee.once(event, h);
+                    }
+
+                    ee.emit(event, 1);
+                },
+                1);
+
+        Report("once_churn")("pool", POOL)
+                .rate((total / POOL) * POOL, elapsed)("deliveries", count);
+    }
+
+    void bench_lookup(AsyncTool& at)
+    {
+        const std::size_t total = 1000000 * scale;
+
+        for (auto events_count : {10, 100, 1000}) {
+            BenchEmitter ee{at};
+            std::deque<IEventEmitter::EventType> events;
+            std::deque<std::string> names;
+
+            for (auto i = 0; i < events_count; ++i) {
+                names.emplace_back("Event" + std::to_string(i));
+                events.emplace_back(names.back().c_str());
+            }
+
+            Clock::duration elapsed{};
+
+            run_in_loop(at, [&]() {
+                const auto start = Clock::now();
+
+                for (auto& et : events) {
+                    ee.register_event<int>(et);
+                }
+
+                elapsed = Clock::now() - start;
+            });
+
+            Report("lookup")("events", events_count)("mode", "register")
+                    .rate(events_count, elapsed);
+
+            run_in_loop(at, [&]() {
+                IEventEmitter::EventHandler handler([](int) {});
+                const auto start = Clock::now();
+
+                for (std::size_t i = 0; i < total; ++i) {
+                    const auto name = names[i % events_count].c_str();
+                    ee.on(name, handler);
+                    ee.off(name, handler);
+                }
+
+                elapsed = Clock::now() - start;
+            });
+
+            Report("lookup")("events", events_count)("mode", "on_off")
+                    .rate(total, elapsed);
+
+            IEventEmitter::EventType by_name{names[events_count / 2].c_str()};
+            auto& by_id = events[events_count / 2];
+
+            // NOTE: no listeners, so only lookup and argument check
+            elapsed = emit_chunked(at, total, [&]() { ee.emit(by_id, 1); });
+            Report("lookup")("events", events_count)("mode", "id")
+                    .rate(total, elapsed);
+
+            elapsed = emit_chunked(at, total, [&]() { ee.emit(by_name, 1); });
+            Report("lookup")("events", events_count)("mode", "name")
+                    .rate(total, elapsed);
+        }
+    }
+
+    template<typename... T, typename... A>
+    void bench_args_case(
+            AsyncTool& at, const char* kind, std::size_t bytes, A&&... args)
+    {
+        const std::size_t total = 500000 * scale;
+
+        BenchEmitter ee{at};
+        IEventEmitter::EventType event{"Event"};
+        ee.register_event<T...>(event);
+        BenchEmitter::setDispatchBatch(ee, 0);
+
+        std::size_t count = 0;
+        IEventEmitter::EventHandler handler([&](const T&...) { ++count; });
+        ee.on(event, handler);
+
+        // NOTE: variadic emit() of the interface is hidden in EventEmitter
+        IEventEmitter& iee = ee;
+        const auto elapsed = emit_chunked(
+                at, total, [&]() { iee.emit(event, T(args)...); });
+
+        Report("args")("kind", kind)("bytes", bytes)
+                .rate(total, elapsed)("deliveries", count);
+
+        ee.off(event, handler);
+    }
+
+    void bench_args(AsyncTool& at)
+    {
+        bench_args_case<>(at, "none", 0);
+        bench_args_case<int>(at, "int", sizeof(int), 1);
+        bench_args_case<int, int, int, int>(
+                at, "int4", 4 * sizeof(int), 1, 2, 3, 4);
+
+        for (std::size_t bytes : {8, 64, 1024}) {
+            const futoin::string str(bytes, 'x');
+            bench_args_case<futoin::string>(at, "string", bytes, str);
+        }
+    }
+
+    void bench_batch(AsyncTool& at)
+    {
+        const std::size_t total = 1000000 * scale;
+
+        for (std::size_t batch_size : {16, 256}) {
+            BenchEmitter ee{at};
+            IEventEmitter::EventType event{"Event"};
+            ee.register_event<int>(event);
+            BenchEmitter::setDispatchBatch(ee, 0);
+
+            std::size_t count = 0;
+            IEventEmitter::EventHandler handler([&](int) { ++count; });
+            ee.on(event, handler);
+
+            const auto rounds = total / batch_size;
+            const auto expected = rounds * batch_size;
+
+            // NOTE: variadic emit() of the interface is hidden in EventEmitter
+            IEventEmitter& iee = ee;
+            auto elapsed = emit_chunked(
+                    at,
+                    rounds,
+                    [&]() {
+                        for (std::size_t i = 0; i < batch_size; ++i) {
+                            iee.emit(event, int(i));
+                        }
+                    },
+                    1);
+            Report("batch")("batch_size", batch_size)("mode", "emit")
+                    .rate(expected, elapsed)("deliveries", count);
+
+            count = 0;
+            elapsed = emit_chunked(
+                    at,
+                    rounds,
+                    [&]() {
+                        BenchEmitter::ArgsBatch batch;
+                        batch.reserve(batch_size);
+
+                        for (std::size_t i = 0; i < batch_size; ++i) {
+                            batch.emplace_back(int(i));
+                        }
+
+                        ee.emit_batch(event, std::move(batch));
+                    },
+                    1);
+            Report("batch")("batch_size", batch_size)("mode", "emit_batch")
+                    .rate(expected, elapsed)("deliveries", count);
+
+            ee.off(event, handler);
+        }
+    }
+
+    // Re-publish through facade: handler with emit() vs forward()
+    void bench_forward(AsyncTool& at)
+    {
+        const std::size_t total = 500000 * scale;
+
+        for (auto native : {false, true}) {
+            BenchEmitter inner{at};
+            BenchEmitter facade{at};
+            IEventEmitter::EventType inner_event{"InnerEvent"};
+            inner.register_event<int>(inner_event);
+            IEventEmitter::EventType facade_event{"FacadeEvent"};
+            facade.register_event<int>(facade_event);
+            BenchEmitter::setDispatchBatch(inner, 0);
+            BenchEmitter::setDispatchBatch(facade, 0);
+
+            std::size_t count = 0;
+            IEventEmitter::EventHandler handler([&](int) { ++count; });
+            facade.on(facade_event, handler);
+
+            IEventEmitter& facade_ee = facade;
+            IEventEmitter::EventHandler republish(
+                    [&](int a) { facade_ee.emit(facade_event, a); });
+
+            if (native) {
+                inner.forward(inner_event, facade, facade_event);
+            } else {
+                inner.on(inner_event, republish);
+            }
+
+            // NOTE: variadic emit() of the interface is hidden in EventEmitter
+            IEventEmitter& inner_ee = inner;
+            const auto elapsed = emit_chunked(
+                    at, total, [&]() { inner_ee.emit(inner_event, 1); });
+
+            // Let re-published emits drain
+            std::promise<void> drained;
+            at.immediate([&]() { drained.set_value(); });
+            drained.get_future().wait();
+
+            Report("forward")("mode", native ? "forward" : "handler")
+                    .rate(total, elapsed)("deliveries", count);
+
+            if (native) {
+                inner.unforward(inner_event, facade, facade_event);
+            } else {
+                inner.off(inner_event, republish);
+            }
+
+            facade.off(facade_event, handler);
+        }
+    }
+
+    // Overhead of listener timing by sampling rate, 0 - disabled
+    void bench_timing(AsyncTool& at)
+    {
+        const std::size_t total = 1000000 * scale;
+
+        for (std::size_t every : {0, 1, 16, 256}) {
+            BenchEmitter ee{at};
+            IEventEmitter::EventType event{"Event"};
+            ee.register_event<int>(event);
+            BenchEmitter::setDispatchBatch(ee, 0);
+
+            std::size_t count = 0;
+            IEventEmitter::EventHandler handler([&](int) { ++count; });
+            ee.on(event, handler);
+
+            BenchEmitter::ListenerTiming timing;
+            timing.sample_every = every;
+
+            std::promise<void> ready;
+            at.immediate([&]() {
+                BenchEmitter::setListenerTiming(ee, timing);
+                ready.set_value();
+            });
+            ready.get_future().wait();
+
+            const auto elapsed =
+                    emit_chunked(at, total, [&]() { ee.emit(event, 1); });
+
+            Report("timing")("sample_every", every)
+                    .rate(total, elapsed)("deliveries", count);
+
+            ee.off(event, handler);
+        }
+    }
+
+    void bench_cross_thread(AsyncTool& at)
+    {
+        const std::size_t total = 400000 * scale;
+
+        for (auto producers : {1, 2, 4}) {
+            BenchEmitter ee{at};
+            IEventEmitter::EventType event{"Event"};
+            ee.register_event<int>(event);
+
+            const auto per_producer = total / producers;
+            const auto expected = per_producer * producers;
+            std::size_t count = 0;
+            std::promise<void> done;
+
+            IEventEmitter::EventHandler handler([&](int) {
+                if (++count == expected) {
+                    done.set_value();
+                }
+            });
+            ee.on(event, handler);
+
+            const auto start = Clock::now();
+            std::vector<std::thread> threads;
+
+            for (auto p = 0; p < producers; ++p) {
+                threads.emplace_back([&]() {
+                    for (std::size_t i = 0; i < per_producer; ++i) {
+                        ee.emit(event, 1);
+                    }
+                });
+            }
+
+            for (auto& t : threads) {
+                t.join();
+            }
+
+            done.get_future().wait();
+            const auto elapsed = Clock::now() - start;
+
+            Report("cross_thread")("producers", producers)
+                    .rate(expected, elapsed);
+
+            ee.off(event, handler);
+            run_in_loop(at, []() {});
+        }
+    }
+    void bench_concurrent()
+    {
+        const std::size_t per_thread = 1000000 * scale;
+        const std::size_t max_threads =
+                std::max<std::size_t>(std::thread::hardware_concurrency(), 4);
+
+        for (std::size_t threads_count = 1; threads_count <= max_threads;
+             threads_count *= 2) {
+            BenchConcurrentEmitter ee;
+            IEventEmitter::EventType event{"Event"};
+            ee.register_event<int>(event);
+
+            std::atomic<std::size_t> count{0};
+            IEventEmitter::EventHandler handler(
+                    [](int) { ++thread_deliveries; });
+            ee.on(event, handler);
+
+            // NOTE: variadic emit() of the interface is hidden
+            IEventEmitter& iee = ee;
+            std::atomic<std::size_t> ready{0};
+            std::vector<std::thread> threads;
+
+            const auto start = Clock::now();
+
+            for (std::size_t t = 0; t < threads_count; ++t) {
+                threads.emplace_back([&]() {
+                    ready.fetch_add(1);
+
+                    while (ready.load() != threads_count) {
+                        std::this_thread::yield();
+                    }
+
+                    thread_deliveries = 0;
+
+                    for (std::size_t i = 0; i < per_thread; ++i) {
+                        iee.emit(event, 1);
+                    }
+
+                    count.fetch_add(thread_deliveries);
+                });
+            }
+
+            for (auto& t : threads) {
+                t.join();
+            }
+
+            const auto elapsed = Clock::now() - start;
+
+            Report("concurrent")("threads", threads_count)
+                    .rate(per_thread * threads_count, elapsed)(
+                            "deliveries", count.load());
+
+            ee.off(event, handler);
+        }
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) {
+        scale = std::max(std::atoi(argv[1]), 1);
+    }
+
+    // Keep counters in integer notation
+    std::cout.precision(15);
+
+    AsyncTool at;
+
+    bench_throughput(at);
+    bench_latency(at);
+    bench_once_churn(at);
+    bench_lookup(at);
+    bench_args(at);
+    bench_batch(at);
+    bench_forward(at);
+    bench_timing(at);
+    bench_cross_thread(at);
+    bench_concurrent();
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+//-----------------------------------------------------------------------------
+//   Copyright 2018 FutoIn Project
+//   Copyright 2018 Andrey Galkin
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//-----------------------------------------------------------------------------
+//! @file
+//! @brief Thread-safe EventEmitter without event loop
+//-----------------------------------------------------------------------------
+
+#ifndef FUTOIN_RI_CONCURRENTEVENTEMITTER_HPP
+#define FUTOIN_RI_CONCURRENTEVENTEMITTER_HPP
+//---
+#include <futoin/ieventemitter.hpp>
+//---
+#include <memory>
+//---
+
+namespace futoin {
+    namespace ri {
+        /**
+         * @brief EventEmitter for use from any number of threads
+         *
+         * Listeners run in the thread of emit() before it returns. Emits
+         * read immutable listener snapshots and never lock. Registration,
+         * on(), once() and off() copy the snapshot under a lock and wait
+         * for emits which may still use the old one.
+         *
+         * @note off() guarantees the handler is not running anymore, so
+         *       it can be destroyed right after. The only exception is
+         *       off() called from a listener of the same emitter, which
+         *       does not wait.
+         * @warning on(), once(), off() and registration called from a
+         *          listener still wait for emits of other emitters. Two
+         *          threads must not do that crosswise from listeners of
+         *          each other's emitter as they would wait forever.
+         * @note Emits do not modify handlers. Fired once handler stays
+         *       bound to the emitter until off() or the next on()/once()
+         *       with it. off() of a fired once handler is a no-op.
+         */
+        class ConcurrentEventEmitter : virtual public IEventEmitter
+        {
+        public:
+            ConcurrentEventEmitter(const ConcurrentEventEmitter&) = delete;
+            ConcurrentEventEmitter& operator=(const ConcurrentEventEmitter&) =
+                    delete;
+
+            void on(const EventType& event,
+                    EventHandler& handler) noexcept override;
+            void once(const EventType& event,
+                      EventHandler& handler) noexcept override;
+            void off(const EventType& event,
+                     EventHandler& handler) noexcept override;
+
+            void emit(const EventType& event) noexcept override;
+            void emit(
+                    const EventType& event, NextArgs&& args) noexcept override;
+
+        protected:
+            void register_event_impl(
+                    EventType& event,
+                    TestCast test_cast,
+                    const NextArgs& model_args) noexcept override;
+
+            ConcurrentEventEmitter() noexcept;
+            ~ConcurrentEventEmitter() noexcept override;
+
+        private:
+            struct Impl;
+            std::unique_ptr<Impl> impl_;
+
+            void add_listener(
+                    const EventType& event,
+                    EventHandler& handler,
+                    bool once) noexcept;
+        };
+    } // namespace ri
+} // namespace futoin
+
+//---
+#endif // FUTOIN_RI_CONCURRENTEVENTEMITTER_HPP
@@ -24,43 +24,599 @@
 //---
 #include <futoin/iasynctool.hpp>
 #include <futoin/ieventemitter.hpp>
+#include <futoin/imempool.hpp>
 //---
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
 //---
 
 namespace futoin {
     namespace ri {
+        class EventSchema;
+
         /**
          * @brief Implementation of async EventEmitter
+         *
+         * Calls from other threads: emit(), on() and once() with registered
+         * EventType objects are queued without waiting. Registration, off()
+         * and name-based calls block until processed in event loop.
          */
         class EventEmitter : virtual public IEventEmitter
         {
         public:
+            /**
+             * @brief Event type with argument types known at compile time
+             */
+            template<typename... T>
+            class TypedEventType : public EventType
+            {
+            public:
+                TypedEventType(const char* event_type) noexcept :
+                    EventType(event_type)
+                {}
+            };
+
+            /**
+             * @brief Event handler checked against event arguments at
+             *        compile time
+             */
+            template<typename... T>
+            class TypedEventHandler : public EventHandler
+            {
+            public:
+                template<
+                        typename Callable,
+                        typename = decltype(std::declval<Callable&>()(
+                                std::declval<const T&>()...))>
+                TypedEventHandler(Callable&& callable) noexcept :
+                    EventHandler(std::forward<Callable>(callable))
+                {}
+            };
+
+            /**
+             * @brief Listener of all events: event ID, name and arguments
+             */
+            using AnyEventHandler =
+                    std::function<void(EventID, const char*, const NextArgs&)>;
+
+            /**
+             * @brief Argument packs of emit_batch()
+             */
+            using ArgsBatch = std::vector<NextArgs>;
+
+            /**
+             * @brief Dispatch lane of event, higher lanes go first
+             */
+            enum class Priority : std::uint8_t
+            {
+                high,
+                normal,
+                low,
+            };
+
+            static constexpr std::size_t PRIORITY_COUNT = 3;
+
+            /**
+             * @brief Action on emit when event has too many pending emits
+             */
+            enum class OverflowPolicy : std::uint8_t
+            {
+                drop_newest,
+                drop_oldest,
+                //! Replace arguments of the latest pending emit
+                coalesce,
+                //! try_emit() returns false, emit() is fatal
+                fail,
+            };
+
+            /**
+             * @brief Limit of dispatch rate for bursty events
+             */
+            enum class RateLimit : std::uint8_t
+            {
+                none,
+                //! Dispatch at most once per interval, the latest of held
+                //! emits goes at the end of interval
+                throttle,
+                //! Dispatch the latest emit after interval without emits
+                debounce,
+            };
+
+            /**
+             * @brief Per-event options for register_event()
+             */
+            struct EventOptions
+            {
+                //! Pending emit gets only the latest arguments
+                bool coalesce{false};
+                Priority priority{Priority::normal};
+                //! 0 - use setMaxPending() of emitter
+                SizeType max_pending{0};
+                OverflowPolicy overflow{OverflowPolicy::drop_newest};
+                //! Held emits do not queue tasks, only the latest args kept
+                RateLimit rate_limit{RateLimit::none};
+                std::chrono::milliseconds rate_interval{0};
+            };
+
+            /**
+             * @brief Overflow counters of emitter
+             */
+            struct QueueStats
+            {
+                std::size_t dropped{0};
+                std::size_t coalesced{0};
+            };
+
+            /**
+             * @brief Queueing statistics of dispatch lane
+             */
+            struct LaneStats
+            {
+                std::size_t dispatched{0};
+                //! Only with setLaneTiming() enabled
+                std::chrono::nanoseconds total_wait{0};
+                std::chrono::nanoseconds max_wait{0};
+            };
+
+            static constexpr std::size_t WAIT_BUCKETS = 32;
+
+            /**
+             * @brief Per-event counters of metrics snapshot
+             */
+            struct EventMetrics
+            {
+                const char* name{nullptr};
+                std::uint64_t emits{0};
+                std::uint64_t deliveries{0};
+                std::uint64_t once_deliveries{0};
+                //! Removed listener slots
+                std::uint64_t tombstones{0};
+                std::uint64_t peak_pending{0};
+                //! Bucket N counts queue waits of [2^N, 2^(N+1)) ns
+                std::array<std::uint64_t, WAIT_BUCKETS> wait_histogram{};
+            };
+
+            using MetricsSnapshot = std::vector<EventMetrics>;
+
+            /**
+             * @brief Report of listener over budget: event name, listener
+             *        slot index and run time of the call
+             */
+            using SlowListenerHandler = std::function<void(
+                    const char*, std::size_t, std::chrono::nanoseconds)>;
+
+            /**
+             * @brief Options of setListenerTiming()
+             */
+            struct ListenerTiming
+            {
+                //! 0 - disabled, N - time every N-th dispatch
+                SizeType sample_every{0};
+                //! 0 - do not report slow listeners
+                std::chrono::nanoseconds budget{0};
+                //! Empty - WARN to FatalMsgHook::stream()
+                SlowListenerHandler on_slow;
+            };
+
+            /**
+             * @brief Run time of sampled listener calls
+             */
+            struct HandlerTiming
+            {
+                std::uint64_t samples{0};
+                std::chrono::nanoseconds total{0};
+                std::chrono::nanoseconds max{0};
+            };
+
+            struct EventTiming
+            {
+                //! All listener calls of the event
+                HandlerTiming total;
+                //! By listener slot index
+                std::vector<HandlerTiming> listeners;
+            };
+
             static void setMaxListeners(
                     EventEmitter& ee, SizeType max_listeners) noexcept;
 
+            /**
+             * @brief Control how many queued emits run per loop iteration
+             * @note 1 (default) - schedule a separate dispatch per emit,
+             *       0 - drain the whole queue at once,
+             *       N - run up to N emits, then yield to the loop.
+             */
+            static void setDispatchBatch(
+                    EventEmitter& ee, SizeType batch_size) noexcept;
+
+            /**
+             * @brief Copy metrics of all registered events
+             * @note Safe to call from any thread. Always empty unless
+             *       built with FUTOIN_EVENTEMITTER_METRICS.
+             */
+            static MetricsSnapshot getMetrics(const EventEmitter& ee) noexcept;
+
+            /**
+             * @brief Limit pending emits per event
+             * @note 0 (default) - only the internal limit of 65535. It is
+             *       a debug assertion, further emits get dropped in release.
+             *       Policy applies only to an explicitly set limit.
+             */
+            static void setMaxPending(
+                    EventEmitter& ee,
+                    SizeType max_pending,
+                    OverflowPolicy overflow) noexcept;
+
+            /**
+             * @brief Counters of dropped and coalesced emits
+             * @note Must be called in event loop thread.
+             */
+            static QueueStats getQueueStats(const EventEmitter& ee) noexcept;
+
+            /**
+             * @brief Measure time emits spend queued in lanes
+             * @note Disabled by default as it costs clock reads per emit.
+             */
+            static void setLaneTiming(EventEmitter& ee, bool enabled) noexcept;
+
+            /**
+             * @brief Dispatch counters of the lane
+             * @note Must be called in event loop thread.
+             */
+            static LaneStats getLaneStats(
+                    const EventEmitter& ee, Priority priority) noexcept;
+
+            /**
+             * @brief Time persistent listener calls of sampled dispatches
+             * @note Must be called in event loop thread. Slot index of
+             *       listener shifts only when removed slots get compacted.
+             */
+            static void setListenerTiming(
+                    EventEmitter& ee, const ListenerTiming& timing) noexcept;
+
+            /**
+             * @brief Accumulated listener timing of event
+             * @note Must be called in event loop thread.
+             */
+            static EventTiming getEventTiming(
+                    const EventEmitter& ee, const EventType& event) noexcept;
+
             void on(const EventType& event,
                     EventHandler& handler) noexcept override;
             void once(const EventType& event, EventHandler& handler) noexcept
                     override;
+            /**
+             * @brief Run handler in target event loop
+             * @note Handler gets a shared copy of arguments after
+             *       all local listeners. off() from event loop thread does
+             *       not wait for already running call of the handler.
+             *       off() from other thread waits for it, unless called
+             *       from within the handler itself.
+             */
+            void on(const EventType& event,
+                    EventHandler& handler,
+                    IAsyncTool& target) noexcept;
+            void once(
+                    const EventType& event,
+                    EventHandler& handler,
+                    IAsyncTool& target) noexcept;
             void off(const EventType& event, EventHandler& handler) noexcept
                     override;
+            /**
+             * @brief Listen to every event of emitter
+             * @note Runs in the same dispatch after regular listeners.
+             */
+            void on_any(AnyEventHandler& handler) noexcept;
+            void off_any(AnyEventHandler& handler) noexcept;
+
+            /**
+             * @brief Re-emit event through other emitter of the same loop
+             * @note Target listeners run within the same dispatch after
+             *       local ones, without own queue, rate limit or coalescing.
+             *       Argument types are checked once here. Target must
+             *       outlive the binding.
+             */
+            void forward(
+                    const EventType& event,
+                    EventEmitter& target,
+                    const EventType& target_event) noexcept;
+            void unforward(
+                    const EventType& event,
+                    EventEmitter& target,
+                    const EventType& target_event) noexcept;
+
             void emit(const EventType& event) noexcept override;
             void emit(
                     const EventType& event, NextArgs&& args) noexcept override;
 
+            /**
+             * @brief Check for any listener incl. once, remote and on_any()
+             * @note Blocks when called from other threads.
+             */
+            bool has_listeners(const EventType& event) noexcept;
+            std::size_t listener_count(const EventType& event) noexcept;
+
+            /**
+             * @brief Emit with arguments built only if somebody listens
+             * @param factory callable returning NextArgs
+             * @note Always builds arguments when called from other threads.
+             */
+            template<typename Factory>
+            void emit_lazy(const EventType& event, Factory&& factory) noexcept
+            {
+                using F = typename std::remove_reference<Factory>::type;
+                emit_lazy_impl(
+                        event,
+                        [](void* ctx) -> NextArgs {
+                            return (*static_cast<F*>(ctx))();
+                        },
+                        const_cast<void*>(
+                                static_cast<const void*>(&factory)));
+            }
+
+            /**
+             * @brief Emit argument packs in order as a single queued task
+             * @note Listeners run once per pack within one dispatch and
+             *       once listeners only for the first. Coalescing keeps
+             *       only the last pack.
+             */
+            void emit_batch(const EventType& event, ArgsBatch&& batch) noexcept;
+
+            /**
+             * @brief Emit reporting overflow instead of fatal error
+             * @return false, if rejected by OverflowPolicy::fail
+             * @note Blocks when called from other threads.
+             */
+            bool try_emit(const EventType& event) noexcept;
+            bool try_emit(const EventType& event, NextArgs&& args) noexcept;
+
+            template<typename A, typename... T>
+            bool try_emit(const EventType& event, A&& a, T&&... args) noexcept
+            {
+                return try_emit(
+                        event,
+                        NextArgs(std::forward<A>(a), std::forward<T>(args)...));
+            }
+
+            /**
+             * @brief Invoke listeners before return, without loop round trip
+             * @note Falls back to regular emit() while earlier emits of
+             *       the same event are pending to keep the order.
+             * @warning Caller is responsible for re-entrancy of handlers.
+             */
+            void emit_now(const EventType& event) noexcept;
+            void emit_now(const EventType& event, NextArgs&& args) noexcept;
+
+            template<typename A, typename... T>
+            void emit_now(const EventType& event, A&& a, T&&... args) noexcept
+            {
+                emit_now(
+                        event,
+                        NextArgs(std::forward<A>(a), std::forward<T>(args)...));
+            }
+
+            template<typename... T>
+            void on(const TypedEventType<T...>& event,
+                    TypedEventHandler<T...>& handler) noexcept
+            {
+                on(static_cast<const EventType&>(event),
+                   static_cast<EventHandler&>(handler));
+            }
+
+            template<typename... T>
+            void once(
+                    const TypedEventType<T...>& event,
+                    TypedEventHandler<T...>& handler) noexcept
+            {
+                once(static_cast<const EventType&>(event),
+                     static_cast<EventHandler&>(handler));
+            }
+
+            /**
+             * @brief Emit without runtime argument type check
+             * @note The check is still done in debug builds.
+             */
+            template<typename... T, typename... A>
+            void emit(const TypedEventType<T...>& event, A&&... args) noexcept
+            {
+                static_assert(
+                        AllTrue<std::is_convertible<A, T>::value...>::value,
+                        "emit() arguments must implicitly convert to "
+                        "TypedEventType argument types");
+                emit_typed(
+                        event,
+                        NextArgs(implicit_cast<T>(std::forward<A>(args))...));
+            }
+
         protected:
+            using IEventEmitter::register_event;
+
+            template<typename... T>
+            void register_event(TypedEventType<T...>& event) noexcept
+            {
+                IEventEmitter::register_event<T...>(event);
+            }
+
+            template<typename... T>
+            void register_event(
+                    EventType& event, const EventOptions& options) noexcept
+            {
+                IEventEmitter::register_event<T...>(event);
+                set_event_options(event, options);
+            }
+
+            template<typename... T>
+            void register_event(
+                    TypedEventType<T...>& event,
+                    const EventOptions& options) noexcept
+            {
+                IEventEmitter::register_event<T...>(event);
+                set_event_options(event, options);
+            }
+
             void register_event_impl(
                     EventType& event,
                     TestCast test_cast,
                     const NextArgs& model_args) noexcept override;
 
+            /**
+             * @brief Change options of registered event
+             * @note Fatal with pending emits. Emit held by previous rate
+             *       limit gets delivered before the change.
+             */
+            void set_event_options(
+                    const EventType& event,
+                    const EventOptions& options) noexcept;
+
+            /**
+             * @brief Create emitter without allocations
+             * @note Internal state comes from the memory pool on first
+             *       registration or listener. Until then, emits of schema
+             *       events are no-op. First use from other thread blocks
+             *       until the state is created in event loop.
+             */
             EventEmitter(IAsyncTool& async_tool) noexcept;
+
+            /**
+             * @brief Use custom memory pool for all internal allocations
+             * @note The pool must outlive the emitter.
+             */
+            EventEmitter(IAsyncTool& async_tool, IMemPool& mem_pool) noexcept;
+
+            /**
+             * @brief Use events declared once in shared schema
+             * @note Schema events are set up on first use. The schema must
+             *       outlive the emitter.
+             */
+            EventEmitter(
+                    IAsyncTool& async_tool,
+                    const EventSchema& schema) noexcept;
+            EventEmitter(
+                    IAsyncTool& async_tool,
+                    IMemPool& mem_pool,
+                    const EventSchema& schema) noexcept;
             ~EventEmitter() noexcept override;
 
         private:
             struct Impl;
+
+            IAsyncTool& async_tool_;
+            IMemPool& mem_pool_;
+            const EventSchema* const schema_;
+            std::atomic<Impl*> impl_{nullptr};
+
+            Impl& impl() noexcept;
+            Impl& create_impl() noexcept;
+            bool skip_idle(
+                    const EventType& event,
+                    const NextArgs* args = nullptr) noexcept;
+
+            using ArgsFactory = NextArgs (*)(void* ctx);
+
+            template<bool...>
+            struct BoolPack;
+
+            template<bool... B>
+            using AllTrue =
+                    std::is_same<BoolPack<true, B...>, BoolPack<B..., true>>;
+
+            // No explicit conversions, unlike T(arg)
+            template<typename T>
+            static T implicit_cast(T value) noexcept
+            {
+                return value;
+            }
+
+            void emit_typed(const EventType& event, NextArgs&& args) noexcept;
+            void emit_lazy_impl(
+                    const EventType& event,
+                    ArgsFactory factory,
+                    void* factory_ctx) noexcept;
+        };
+
+        /**
+         * @brief Static table of events shared by emitters of a class
+         *
+         * Names, IDs, argument checks and options are kept once. Emitters
+         * created with the schema accept its EventType objects and keep
+         * only own listener state.
+         * @note Not thread-safe. Fill it once before the first emitter is
+         *       created, e.g. in function-local static.
+         * @note Not an emitter. IEventEmitter is a private base only to
+         *       reuse event registration.
+         */
+        class EventSchema final : private IEventEmitter
+        {
+        public:
+            using EventOptions = EventEmitter::EventOptions;
+
+            EventSchema() noexcept;
+            EventSchema(const EventSchema&) = delete;
+            EventSchema& operator=(const EventSchema&) = delete;
+            ~EventSchema() noexcept override;
+
+            template<typename... T>
+            void add(EventType& event) noexcept
+            {
+                register_event<T...>(event);
+            }
+
+            template<typename... T>
+            void add(EventEmitter::TypedEventType<T...>& event) noexcept
+            {
+                register_event<T...>(event);
+            }
+
+            template<typename... T>
+            void add(EventType& event, const EventOptions& options) noexcept
+            {
+                register_event<T...>(event);
+                set_event_options(event, options);
+            }
+
+            template<typename... T>
+            void add(
+                    EventEmitter::TypedEventType<T...>& event,
+                    const EventOptions& options) noexcept
+            {
+                register_event<T...>(event);
+                set_event_options(event, options);
+            }
+
+            //! Number of declared events
+            std::size_t size() const noexcept;
+
+        private:
+            friend class EventEmitter;
+
+            void register_event_impl(
+                    EventType& event,
+                    TestCast test_cast,
+                    const NextArgs& model_args) noexcept override;
+
+            // Unreachable through private base, all fatal
+            void on(const EventType& event,
+                    EventHandler& handler) noexcept override;
+            void once(const EventType& event,
+                      EventHandler& handler) noexcept override;
+            void off(const EventType& event,
+                     EventHandler& handler) noexcept override;
+            void emit(const EventType& event) noexcept override;
+            void emit(
+                    const EventType& event, NextArgs&& args) noexcept override;
+
+            struct Impl;
             std::unique_ptr<Impl> impl_;
+
+            void set_event_options(
+                    const EventType& event,
+                    const EventOptions& options) noexcept;
         };
     } // namespace ri
 } // namespace futoin
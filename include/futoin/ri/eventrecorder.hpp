@@ -0,0 +1,285 @@
+//-----------------------------------------------------------------------------
+//   Copyright 2018 FutoIn Project
+//   Copyright 2018 Andrey Galkin
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//-----------------------------------------------------------------------------
+//! @file
+//! @brief Binary recording and replay of event streams
+//-----------------------------------------------------------------------------
+
+#ifndef FUTOIN_RI_EVENTRECORDER_HPP
+#define FUTOIN_RI_EVENTRECORDER_HPP
+//---
+#include <futoin/ieventemitter.hpp>
+//---
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+//---
+
+namespace futoin {
+    namespace ri {
+        /**
+         * @brief Sequential writer of record payload
+         */
+        class TraceOutput
+        {
+        public:
+            void write(const void* data, std::size_t size) noexcept
+            {
+                auto p = static_cast<const std::uint8_t*>(data);
+                buffer_.insert(buffer_.end(), p, p + size);
+            }
+
+            void write_varint(std::uint64_t value) noexcept;
+
+        private:
+            friend class EventRecorder;
+            std::vector<std::uint8_t> buffer_;
+        };
+
+        /**
+         * @brief Sequential reader of record payload
+         */
+        class TraceInput
+        {
+        public:
+            TraceInput(
+                    const std::uint8_t* begin,
+                    const std::uint8_t* end) noexcept :
+                pos_(begin),
+                end_(end)
+            {}
+
+            const std::uint8_t* read(std::uint64_t size) noexcept;
+            //! Read count items, checked against the remaining size
+            const std::uint8_t* read(
+                    std::uint64_t count, std::size_t item_size) noexcept;
+            std::uint64_t read_varint() noexcept;
+
+            bool empty() const noexcept
+            {
+                return pos_ == end_;
+            }
+
+        private:
+            const std::uint8_t* pos_;
+            const std::uint8_t* end_;
+        };
+
+        /**
+         * @brief Binary codec of event argument for trace files
+         * @note Specialize for custom argument types.
+         */
+        template<typename T, typename = void>
+        struct TraceCodec
+        {
+            static_assert(
+                    sizeof(T) == 0,
+                    "TraceCodec specialization is required for the type");
+        };
+
+        template<typename T>
+        struct TraceCodec<
+                T,
+                typename std::enable_if<
+                        std::is_arithmetic<T>::value
+                        || std::is_enum<T>::value>::type>
+        {
+            static void encode(TraceOutput& out, const T& value) noexcept
+            {
+                out.write(&value, sizeof(T));
+            }
+
+            static T decode(TraceInput& in) noexcept
+            {
+                T value;
+                std::memcpy(&value, in.read(sizeof(T)), sizeof(T));
+                return value;
+            }
+        };
+
+        template<typename C, typename Traits, typename Allocator>
+        struct TraceCodec<std::basic_string<C, Traits, Allocator>>
+        {
+            using Str = std::basic_string<C, Traits, Allocator>;
+
+            static void encode(TraceOutput& out, const Str& value) noexcept
+            {
+                out.write_varint(value.size());
+                out.write(value.data(), value.size() * sizeof(C));
+            }
+
+            static Str decode(TraceInput& in) noexcept
+            {
+                const auto size = in.read_varint();
+                auto data = reinterpret_cast<const C*>(
+                        in.read(size, sizeof(C)));
+                return Str(data, std::size_t(size));
+            }
+        };
+
+        /**
+         * @brief Appends dispatched events to memory-mapped trace file
+         *
+         * Each recorded event is a channel with its name and argument
+         * types. Records hold channel, time since start and arguments.
+         * @note Byte order and value layout are of the host.
+         * @note POSIX only, see FUTOIN_WITH_EVENTRECORDER build option.
+         */
+        class EventRecorder
+        {
+        public:
+            using EventType = IEventEmitter::EventType;
+            using EventHandler = IEventEmitter::EventHandler;
+
+            /**
+             * @brief Create or truncate trace file
+             */
+            EventRecorder(const char* path) noexcept;
+            EventRecorder(const EventRecorder&) = delete;
+            EventRecorder& operator=(const EventRecorder&) = delete;
+
+            /**
+             * @brief Detach from emitters and finalize file
+             */
+            ~EventRecorder() noexcept;
+
+            /**
+             * @brief Record every emit of the event under channel name
+             * @note Recorded on dispatch in event loop of the emitter.
+             *       EventType object must outlive the recorder.
+             */
+            template<typename... T>
+            void record(
+                    IEventEmitter& ee,
+                    const EventType& event,
+                    const char* name) noexcept
+            {
+                auto& channel = add_channel(ee, event, name);
+                const auto id = channel.id;
+
+                channel.handler = [this, id](const T&... args) {
+                    auto& out = begin_record();
+                    encode_all<T...>(out, args...);
+                    commit_record(id);
+                };
+
+                ee.on(event, channel.handler);
+            }
+
+            //! Number of records written
+            std::size_t size() const noexcept;
+
+        private:
+            struct Channel
+            {
+                Channel(IEventEmitter& ee,
+                        const EventType& event,
+                        std::uint64_t id) noexcept :
+                    ee(ee),
+                    event(event),
+                    id(id)
+                {}
+
+                IEventEmitter& ee;
+                const EventType& event;
+                const std::uint64_t id;
+                EventHandler handler;
+            };
+
+            struct Impl;
+            std::unique_ptr<Impl> impl_;
+            std::deque<Channel> channels_;
+
+            Channel& add_channel(
+                    IEventEmitter& ee,
+                    const EventType& event,
+                    const char* name) noexcept;
+            TraceOutput& begin_record() noexcept;
+            void commit_record(std::uint64_t channel) noexcept;
+
+            template<typename... T>
+            static void encode_all(TraceOutput&) noexcept
+            {}
+
+            template<typename T, typename... Rest>
+            static void encode_all(
+                    TraceOutput& out,
+                    const T& value,
+                    const Rest&... rest) noexcept
+            {
+                TraceCodec<T>::encode(out, value);
+                encode_all<Rest...>(out, rest...);
+            }
+        };
+
+        /**
+         * @brief Feeds trace file back through emit()
+         */
+        class EventReplay
+        {
+        public:
+            using EventType = IEventEmitter::EventType;
+            using NextArgs = IEventEmitter::NextArgs;
+
+            EventReplay(const char* path) noexcept;
+            EventReplay(const EventReplay&) = delete;
+            EventReplay& operator=(const EventReplay&) = delete;
+            ~EventReplay() noexcept;
+
+            /**
+             * @brief Emit records of channel name as the event
+             * @note Channels without binding are skipped.
+             */
+            template<typename... T>
+            void bind(
+                    IEventEmitter& ee,
+                    const EventType& event,
+                    const char* name) noexcept
+            {
+                add_binding(name, ee, event, [](TraceInput& in) -> NextArgs {
+                    // NOTE: braced list keeps left-to-right decode order
+                    return NextArgs{TraceCodec<T>::decode(in)...};
+                });
+            }
+
+            /**
+             * @brief Emit all records from the calling thread
+             * @param original_speed keep recorded time gaps
+             * @return number of emitted records
+             */
+            std::size_t run(bool original_speed = false) noexcept;
+
+        private:
+            using Decoder = NextArgs (*)(TraceInput& in);
+
+            struct Impl;
+            std::unique_ptr<Impl> impl_;
+
+            void add_binding(
+                    const char* name,
+                    IEventEmitter& ee,
+                    const EventType& event,
+                    Decoder decoder) noexcept;
+        };
+    } // namespace ri
+} // namespace futoin
+
+//---
+#endif // FUTOIN_RI_EVENTRECORDER_HPP
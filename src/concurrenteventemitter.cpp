@@ -0,0 +1,517 @@
+//-----------------------------------------------------------------------------
+//   Copyright 2018 FutoIn Project
+//   Copyright 2018 Andrey Galkin
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//-----------------------------------------------------------------------------
+
+#include <futoin/fatalmsg.hpp>
+#include <futoin/ri/concurrenteventemitter.hpp>
+//---
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Read-copy-update:
+//  - readers enter by counting themselves in stripe of current epoch parity
+//  - writer publishes new pointer, flips epoch and waits for readers of
+//    the previous parity to leave, then old objects are freed
+//  - the wait is outside of write lock, so listeners may call writers
+//  - emits never write to handlers, fired once listeners are dropped by
+//    the next writer
+
+namespace futoin {
+    namespace ri {
+        namespace {
+            constexpr std::size_t READER_STRIPES = 16;
+            constexpr std::size_t CACHE_LINE = 64;
+
+            struct ReaderCount
+            {
+                std::atomic<std::size_t> count{0};
+                char padding[CACHE_LINE - sizeof(std::atomic<std::size_t>)];
+            };
+
+            std::atomic<std::size_t> next_stripe{0};
+            thread_local const std::size_t reader_stripe =
+                    next_stripe.fetch_add(1) % READER_STRIPES;
+
+            // Emitters read by current thread, innermost first
+            struct ReadScope
+            {
+                const void* impl;
+                ReadScope* outer;
+            };
+
+            thread_local ReadScope* read_scopes = nullptr;
+
+            // NOTE: keys point to stored names, so no temporaries on lookup
+            struct NameHash
+            {
+                std::size_t operator()(const char* name) const noexcept
+                {
+                    // FNV-1a
+                    std::size_t res = 2166136261U;
+
+                    for (; *name != '\0'; ++name) {
+                        res ^= static_cast<unsigned char>(*name);
+                        res *= 16777619U;
+                    }
+
+                    return res;
+                }
+            };
+
+            struct NameEqual
+            {
+                bool operator()(const char* a, const char* b) const noexcept
+                {
+                    return std::strcmp(a, b) == 0;
+                }
+            };
+        } // namespace
+
+        struct ConcurrentEventEmitter::Impl
+        {
+            struct Listener
+            {
+                Listener(EventHandler& handler, bool once) noexcept :
+                    handler(handler),
+                    once(once)
+                {}
+
+                EventHandler& handler;
+                const bool once;
+                std::atomic_bool fired{false};
+            };
+
+            // NOTE: immutable after publishing
+            using Snapshot = std::vector<Listener*>;
+
+            struct EventInfo
+            {
+                EventInfo(
+                        const char* name,
+                        EventID eid,
+                        TestCast tc,
+                        const NextArgs& ma) noexcept :
+                    name(name),
+                    event_id(eid),
+                    test_cast(tc),
+                    model_args(&ma)
+                {}
+
+                const std::string name;
+                const EventID event_id;
+                const TestCast test_cast;
+                const NextArgs* const model_args;
+                std::atomic<Snapshot*> listeners{nullptr};
+            };
+
+            // NOTE: immutable after publishing
+            struct EventTable
+            {
+                std::vector<EventInfo*> events;
+                std::unordered_map<const char*, EventInfo*, NameHash, NameEqual>
+                        names;
+            };
+
+            // Unpublished objects waiting for readers to leave
+            struct Retired
+            {
+                Retired() = default;
+                Retired(const Retired&) = delete;
+                Retired& operator=(const Retired&) = delete;
+
+                ~Retired() noexcept
+                {
+                    for (auto s : snapshots) {
+                        delete s;
+                    }
+
+                    for (auto l : listeners) {
+                        delete l;
+                    }
+
+                    for (auto t : tables) {
+                        delete t;
+                    }
+                }
+
+                void swap(Retired& other) noexcept
+                {
+                    snapshots.swap(other.snapshots);
+                    listeners.swap(other.listeners);
+                    tables.swap(other.tables);
+                }
+
+                std::vector<Snapshot*> snapshots;
+                std::vector<Listener*> listeners;
+                std::vector<EventTable*> tables;
+            };
+
+            using WriteLock = std::unique_lock<std::mutex>;
+
+            class ReadGuard
+            {
+            public:
+                ReadGuard(Impl& impl) noexcept : scope_{&impl, read_scopes}
+                {
+                    read_scopes = &scope_;
+
+                    for (;;) {
+                        const auto epoch = impl.epoch.load();
+                        count_ = &(impl.readers[epoch & 1U][reader_stripe]
+                                           .count);
+                        count_->fetch_add(1);
+
+                        // Writer may have flipped epoch in between
+                        if (impl.epoch.load() == epoch) {
+                            break;
+                        }
+
+                        count_->fetch_sub(1);
+                    }
+                }
+
+                ReadGuard(const ReadGuard&) = delete;
+                ReadGuard& operator=(const ReadGuard&) = delete;
+
+                ~ReadGuard() noexcept
+                {
+                    count_->fetch_sub(1, std::memory_order_release);
+                    read_scopes = scope_.outer;
+                }
+
+            private:
+                ReadScope scope_;
+                std::atomic<std::size_t>* count_;
+            };
+
+            Impl(ConcurrentEventEmitter& ee) noexcept :
+                ee(ee),
+                table(new EventTable)
+            {}
+
+            ~Impl() noexcept
+            {
+                for (auto& ei : events) {
+                    auto snapshot = ei.listeners.load();
+
+                    if (snapshot != nullptr) {
+                        for (auto l : *snapshot) {
+                            delete l;
+                        }
+
+                        delete snapshot;
+                    }
+                }
+
+                delete table.load();
+            }
+
+            // NOTE: only under read guard or write lock
+            EventInfo& get_event_info(const EventType& et) noexcept
+            {
+                auto& t = *(table.load());
+                const auto event_id = Accessor::event_id(et);
+
+                if (event_id == NO_EVENT_ID) {
+                    const auto name = Accessor::raw_event_type(et);
+                    auto iter = t.names.find(name);
+
+                    if (iter != t.names.end()) {
+                        return *(iter->second);
+                    }
+
+                    FatalMsg() << "unknown event type: " << name;
+                }
+
+                if (Accessor::event_emitter(et) != &ee) {
+                    FatalMsg() << "foreign event type!";
+                }
+
+                return *(t.events[event_id - 1]);
+            }
+
+            void update(
+                    WriteLock& lock, EventInfo& ei, Snapshot* snapshot) noexcept
+            {
+                if (snapshot->empty()) {
+                    delete snapshot;
+                    snapshot = nullptr;
+                }
+
+                auto old = ei.listeners.exchange(snapshot);
+
+                if (old != nullptr) {
+                    retired.snapshots.push_back(old);
+                }
+
+                synchronize(lock);
+            }
+
+            // Copy of current listeners without fired once listeners
+            Snapshot* copy_listeners(EventInfo& ei) noexcept
+            {
+                auto res = new Snapshot;
+                auto current = ei.listeners.load();
+
+                if (current != nullptr) {
+                    res->reserve(current->size() + 1);
+
+                    for (auto l : *current) {
+                        if (l->fired.load()) {
+                            retired.listeners.push_back(l);
+                        } else {
+                            res->push_back(l);
+                        }
+                    }
+                }
+
+                return res;
+            }
+
+            // Writer inside of own listener must not wait for itself
+            bool is_reading() const noexcept
+            {
+                for (auto s = read_scopes; s != nullptr; s = s->outer) {
+                    if (s->impl == this) {
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            // Live listener of the handler, fired once listeners do not count
+            Listener* find_listener(
+                    EventInfo& ei, const EventHandler& handler) noexcept
+            {
+                auto snapshot = ei.listeners.load();
+
+                if (snapshot != nullptr) {
+                    for (auto l : *snapshot) {
+                        if ((&(l->handler) == &handler) && !l->fired.load()) {
+                            return l;
+                        }
+                    }
+                }
+
+                return nullptr;
+            }
+
+            // NOTE: fired once handler keeps event ID as emits do not
+            //       touch handlers
+            bool is_bound(EventHandler& handler) noexcept
+            {
+                const auto event_id = Accessor::event_id(handler);
+
+                if (event_id == NO_EVENT_ID) {
+                    return false;
+                }
+
+                auto& t = *(table.load());
+
+                if ((Accessor::event_emitter(Accessor::event_type(handler))
+                     != &ee)
+                    || (event_id > t.events.size())) {
+                    return true;
+                }
+
+                return find_listener(*(t.events[event_id - 1]), handler)
+                       != nullptr;
+            }
+
+            // Releases write lock and frees retired objects when safe
+            void synchronize(WriteLock& lock) noexcept
+            {
+                // NOTE: listeners of other emitters still wait to keep off()
+                //       guarantee, see restriction in the header
+                if (is_reading()) {
+                    // Freed by the next writer outside of own listeners
+                    return;
+                }
+
+                Retired to_free;
+                to_free.swap(retired);
+                lock.unlock();
+
+                // NOTE: each flip must drain the previous parity first
+                std::lock_guard<std::mutex> sync_lock(sync_mutex);
+                auto& old_readers = readers[epoch.fetch_add(1) & 1U];
+
+                for (auto& rc : old_readers) {
+                    while (rc.count.load(std::memory_order_acquire) != 0) {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+
+            ConcurrentEventEmitter& ee;
+            std::atomic<EventTable*> table;
+            std::atomic<std::size_t> epoch{0};
+            ReaderCount readers[2][READER_STRIPES];
+            std::mutex write_mutex;
+            std::mutex sync_mutex;
+            std::deque<EventInfo> events;
+            Retired retired;
+        };
+
+        ConcurrentEventEmitter::ConcurrentEventEmitter() noexcept :
+            impl_(new Impl(*this))
+        {}
+
+        ConcurrentEventEmitter::~ConcurrentEventEmitter() noexcept = default;
+
+        void ConcurrentEventEmitter::register_event_impl(
+                EventType& event,
+                TestCast test_cast,
+                const NextArgs& model_args) noexcept
+        {
+            auto& impl = *impl_;
+            Impl::WriteLock lock(impl.write_mutex);
+
+            if (Accessor::event_id(event) != 0) {
+                FatalMsg() << "Re-use of EventType object on registration";
+            }
+
+            const auto raw_name = Accessor::raw_event_type(event);
+            auto old = impl.table.load();
+
+            if (old->names.find(raw_name) != old->names.end()) {
+                FatalMsg() << "Double registration of event: " << raw_name;
+            }
+
+            impl.events.emplace_back(
+                    raw_name, impl.events.size() + 1, test_cast, model_args);
+            auto& ei = impl.events.back();
+
+            auto table = new Impl::EventTable(*old);
+            table->events.push_back(&ei);
+            table->names.emplace(ei.name.c_str(), &ei);
+
+            impl.table.store(table);
+            impl.retired.tables.push_back(old);
+
+            Accessor::event_id(event) = ei.event_id;
+            Accessor::event_emitter(event) = this;
+            impl.synchronize(lock);
+        }
+
+        void ConcurrentEventEmitter::on(
+                const EventType& event, EventHandler& handler) noexcept
+        {
+            add_listener(event, handler, false);
+        }
+
+        void ConcurrentEventEmitter::once(
+                const EventType& event, EventHandler& handler) noexcept
+        {
+            add_listener(event, handler, true);
+        }
+
+        void ConcurrentEventEmitter::add_listener(
+                const EventType& event,
+                EventHandler& handler,
+                bool once) noexcept
+        {
+            auto& impl = *impl_;
+            Impl::WriteLock lock(impl.write_mutex);
+
+            auto& ei = impl.get_event_info(event);
+
+            if (impl.is_bound(handler)) {
+                FatalMsg() << "handler re-use is not supported!";
+            }
+
+            handler.test_cast()(*(ei.model_args));
+
+            auto& handler_et = Accessor::event_type(handler);
+            Accessor::event_id(handler_et) = ei.event_id;
+            Accessor::event_emitter(handler_et) = this;
+
+            auto snapshot = impl.copy_listeners(ei);
+            snapshot->push_back(new Impl::Listener(handler, once));
+            impl.update(lock, ei, snapshot);
+        }
+
+        void ConcurrentEventEmitter::off(
+                const EventType& event, EventHandler& handler) noexcept
+        {
+            auto& impl = *impl_;
+            Impl::WriteLock lock(impl.write_mutex);
+
+            auto& ei = impl.get_event_info(event);
+
+            if ((Accessor::event_id(handler) != ei.event_id)
+                || (Accessor::event_emitter(Accessor::event_type(handler))
+                    != this)) {
+                FatalMsg() << "Not registered handler!";
+            }
+
+            // NOTE: fired once listeners are already gone from the copy,
+            //       so off() after concurrent fire is a no-op
+            auto snapshot = impl.copy_listeners(ei);
+
+            for (auto iter = snapshot->begin(); iter != snapshot->end();
+                 ++iter) {
+                if (&((*iter)->handler) == &handler) {
+                    impl.retired.listeners.push_back(*iter);
+                    snapshot->erase(iter);
+                    break;
+                }
+            }
+
+            Accessor::event_id(handler) = NO_EVENT_ID;
+            impl.update(lock, ei, snapshot);
+        }
+
+        void ConcurrentEventEmitter::emit(const EventType& event) noexcept
+        {
+            emit(event, NextArgs());
+        }
+
+        void ConcurrentEventEmitter::emit(
+                const EventType& event, NextArgs&& args) noexcept
+        {
+            auto& impl = *impl_;
+            Impl::ReadGuard guard(impl);
+
+            auto& ei = impl.get_event_info(event);
+            auto snapshot = ei.listeners.load(std::memory_order_acquire);
+
+            if (snapshot == nullptr) {
+                return;
+            }
+
+            ei.test_cast(args);
+
+            for (auto l : *snapshot) {
+                if (l->once) {
+                    // NOTE: concurrent emits race for once listener
+                    if (l->fired.exchange(true)) {
+                        continue;
+                    }
+                }
+
+                l->handler(args);
+            }
+        }
+    } // namespace ri
+} // namespace futoin
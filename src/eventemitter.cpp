@@ -18,17 +18,387 @@
 #include <futoin/fatalmsg.hpp>
 #include <futoin/ri/eventemitter.hpp>
 //---
+#include <atomic>
 #include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <deque>
 #include <future>
 #include <limits>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#ifdef FUTOIN_EVENTEMITTER_METRICS
+#    define METRICS_ONLY(...) __VA_ARGS__
+#else
+#    define METRICS_ONLY(...)
+#endif
 
 namespace futoin {
     namespace ri {
+        namespace {
+            // NOTE: keys point to stored names, so no temporaries on lookup
+            struct NameHash
+            {
+                std::size_t operator()(const char* name) const noexcept
+                {
+                    // FNV-1a
+                    std::size_t res = 2166136261U;
+
+                    for (; *name != '\0'; ++name) {
+                        res ^= static_cast<unsigned char>(*name);
+                        res *= 16777619U;
+                    }
+
+                    return res;
+                }
+            };
+
+            struct NameEqual
+            {
+                bool operator()(const char* a, const char* b) const noexcept
+                {
+                    return std::strcmp(a, b) == 0;
+                }
+            };
+        } // namespace
+
+        struct EventSchema::Impl
+        {
+            struct Entry
+            {
+                Entry(const char* name,
+                      TestCast tc,
+                      const NextArgs& ma) noexcept :
+                    name(name),
+                    test_cast(tc),
+                    model_args(&ma)
+                {}
+
+                std::string name;
+                TestCast test_cast;
+                const NextArgs* model_args;
+                EventOptions options;
+            };
+
+            // NOTE: deque keeps name pointers stable
+            std::deque<Entry> entries;
+            std::unordered_map<const char*, EventID, NameHash, NameEqual> names;
+        };
+
         struct EventEmitter::Impl
         {
-            using Listeners = std::deque<EventHandler*>;
+            using Listeners =
+                    std::vector<EventHandler*, PoolAllocator<EventHandler*>>;
             using ListenerSize = std::uint16_t;
+            // Index for persistent listeners, sequence for once listeners
+            using SlotID = std::uint32_t;
+            using Clock = std::chrono::steady_clock;
+            using Batch = std::unique_ptr<ArgsBatch>;
+#ifdef FUTOIN_EVENTEMITTER_METRICS
+            static constexpr bool WITH_METRICS = true;
+#else
+            static constexpr bool WITH_METRICS = false;
+#endif
+
+            // Open addressing handler to slot map without node allocation
+            class ListenerSlots
+            {
+            public:
+                ListenerSlots(IMemPool& mem_pool) noexcept :
+                    entries_(Entries::allocator_type(mem_pool))
+                {}
+
+                SlotID* find(const EventHandler* handler) noexcept
+                {
+                    const auto i = locate(handler);
+                    return (i != NOT_FOUND) ? &(entries_[i].slot) : nullptr;
+                }
+
+                void set(const EventHandler* handler, SlotID slot) noexcept
+                {
+                    if ((size_ + 1) * 2 > entries_.size()) {
+                        grow();
+                    }
+
+                    for (auto i = home(handler);; i = next(i)) {
+                        auto& e = entries_[i];
+
+                        if (e.handler == nullptr) {
+                            e.handler = handler;
+                            ++size_;
+                        } else if (e.handler != handler) {
+                            continue;
+                        }
+
+                        e.slot = slot;
+                        return;
+                    }
+                }
+
+                void erase(const EventHandler* handler) noexcept
+                {
+                    auto hole = locate(handler);
+
+                    if (hole == NOT_FOUND) {
+                        return;
+                    }
+
+                    // Backward shift deletion, no tombstones
+                    for (auto i = next(hole);; i = next(i)) {
+                        auto& e = entries_[i];
+
+                        if (e.handler == nullptr) {
+                            break;
+                        }
+
+                        const auto h = home(e.handler);
+                        const bool stays = (hole < i)
+                                                   ? ((hole < h) && (h <= i))
+                                                   : ((hole < h) || (h <= i));
+
+                        if (!stays) {
+                            entries_[hole] = e;
+                            hole = i;
+                        }
+                    }
+
+                    entries_[hole].handler = nullptr;
+                    --size_;
+                }
+
+            private:
+                struct Entry
+                {
+                    SlotID slot;
+                    const EventHandler* handler;
+                };
+
+                using Entries = std::vector<Entry, PoolAllocator<Entry>>;
+
+                static constexpr std::size_t NOT_FOUND =
+                        std::numeric_limits<std::size_t>::max();
+
+                std::size_t locate(const EventHandler* handler) const noexcept
+                {
+                    if (entries_.empty()) {
+                        return NOT_FOUND;
+                    }
+
+                    for (auto i = home(handler);; i = next(i)) {
+                        const auto& e = entries_[i];
+
+                        if (e.handler == handler) {
+                            return i;
+                        }
+
+                        if (e.handler == nullptr) {
+                            return NOT_FOUND;
+                        }
+                    }
+                }
+
+                std::size_t home(const EventHandler* handler) const noexcept
+                {
+                    auto h = reinterpret_cast<std::uintptr_t>(handler);
+                    h ^= h >> 17U;
+                    h *= 0x9E3779B9U;
+                    return (h ^ (h >> 15U)) & (entries_.size() - 1);
+                }
+
+                std::size_t next(std::size_t i) const noexcept
+                {
+                    return (i + 1) & (entries_.size() - 1);
+                }
+
+                void grow() noexcept
+                {
+                    Entries old(
+                            std::max<std::size_t>(entries_.size() * 2U, 16U),
+                            Entry{0, nullptr},
+                            entries_.get_allocator());
+                    old.swap(entries_);
+                    size_ = 0;
+
+                    for (auto& e : old) {
+                        if (e.handler != nullptr) {
+                            set(e.handler, e.slot);
+                        }
+                    }
+                }
+
+                Entries entries_;
+                std::size_t size_{0};
+            };
+
+            // Listener running on other IAsyncTool, shared with its calls
+            // NOTE: cross-loop objects are on the global heap, as they get
+            //       released in other thread than the emitter pool's one
+            struct RemoteListener
+            {
+                RemoteListener(
+                        EventHandler& handler,
+                        IAsyncTool& target,
+                        bool once) noexcept :
+                    handler(handler),
+                    target(target),
+                    once(once)
+                {}
+
+                void release() noexcept
+                {
+                    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        delete this;
+                    }
+                }
+
+                // Listener with call running in this thread
+                static const RemoteListener*& running() noexcept
+                {
+                    static thread_local const RemoteListener* current = nullptr;
+                    return current;
+                }
+
+                // NOTE: handler may deactivate itself from within the call
+                void wait_idle() const noexcept
+                {
+                    if (running() != this) {
+                        std::lock_guard<std::mutex> lock(call_mutex);
+                    }
+                }
+
+                EventHandler& handler;
+                IAsyncTool& target;
+                const bool once;
+                std::atomic<std::size_t> refs{1};
+                std::atomic_bool active{true};
+                // Held for duration of the call
+                mutable std::mutex call_mutex;
+            };
+
+            using AnyListeners = std::
+                    vector<AnyEventHandler*, PoolAllocator<AnyEventHandler*>>;
+
+            using RemoteListeners = std::
+                    vector<RemoteListener*, PoolAllocator<RemoteListener*>>;
+
+            // NOTE: executed in target thread
+            struct RemoteCall
+            {
+                // Call and dispose
+                void run() noexcept
+                {
+                    std::unique_ptr<RemoteCall> done{this};
+                    auto rl = listener;
+
+                    {
+                        std::lock_guard<std::mutex> lock(rl->call_mutex);
+
+                        if (rl->active.load(std::memory_order_acquire)) {
+                            auto& current = RemoteListener::running();
+                            auto outer = current;
+                            current = rl;
+                            rl->handler(*args);
+                            current = outer;
+                        }
+                    }
+
+                    done.reset();
+                    rl->release();
+                }
+
+                RemoteListener* listener;
+                std::shared_ptr<const NextArgs> args;
+            };
+
+            // NOTE: single writer, but read by snapshot from any thread
+            class Counter
+            {
+            public:
+                void add(std::uint64_t n = 1) noexcept
+                {
+                    value_.store(get() + n, std::memory_order_relaxed);
+                }
+
+                void raise(std::uint64_t n) noexcept
+                {
+                    if (n > get()) {
+                        value_.store(n, std::memory_order_relaxed);
+                    }
+                }
+
+                std::uint64_t get() const noexcept
+                {
+                    return value_.load(std::memory_order_relaxed);
+                }
+
+            private:
+                std::atomic<std::uint64_t> value_{0};
+            };
+
+            struct Metrics
+            {
+                void record_wait(Clock::duration wait) noexcept
+                {
+                    auto ns = static_cast<std::uint64_t>(
+                            std::chrono::duration_cast<
+                                    std::chrono::nanoseconds>(wait)
+                                    .count());
+                    std::size_t bucket = 0;
+
+                    for (; (ns > 1) && (bucket < (WAIT_BUCKETS - 1));
+                         ns >>= 1U) {
+                        ++bucket;
+                    }
+
+                    wait_histogram[bucket].add();
+                }
+
+                Counter emits;
+                Counter deliveries;
+                Counter once_deliveries;
+                Counter tombstones;
+                Counter peak_pending;
+                std::array<Counter, WAIT_BUCKETS> wait_histogram;
+            };
+
+            struct EmitTask;
+            struct RateLimiter;
+            struct EventInfo;
+
+            // Sampled listener run time of event
+            struct Timing
+            {
+                HandlerTiming total;
+                std::vector<HandlerTiming> listeners;
+            };
+
+            // Target event of forward() in emitter of the same loop
+            struct Forward
+            {
+                Impl* target;
+                // nullptr - removed
+                EventInfo* event_info;
+            };
+
+            using Forwards = std::vector<Forward, PoolAllocator<Forward>>;
+
+            // Forwarded event with remote listeners, called after all
+            // local ones as they share the args
+            struct Relay
+            {
+                Impl* target;
+                EventInfo* event_info;
+                ListenerSize remote_count;
+            };
+
+            using Relays = std::vector<Relay, PoolAllocator<Relay>>;
 
             struct EventInfo
             {
@@ -36,182 +406,1744 @@ namespace futoin {
                         futoin::string&& name,
                         EventID eid,
                         TestCast tc,
-                        const NextArgs& ma) noexcept :
-                    name(std::forward<futoin::string>(name)),
+                        const NextArgs& ma,
+                        IMemPool& mem_pool) noexcept :
+                    name_storage(std::forward<futoin::string>(name)),
+                    name(name_storage.c_str()),
                     event_id(eid),
                     test_cast(tc),
-                    model_args(&ma)
+                    model_args(&ma),
+                    listeners(Listeners::allocator_type(mem_pool)),
+                    once(Listeners::allocator_type(mem_pool)),
+                    remote(RemoteListeners::allocator_type(mem_pool)),
+                    forwards(Forwards::allocator_type(mem_pool))
+                {}
+
+                // Name is owned by schema
+                EventInfo(
+                        const char* name,
+                        EventID eid,
+                        TestCast tc,
+                        const NextArgs& ma,
+                        IMemPool& mem_pool) noexcept :
+                    name_storage(futoin::string::allocator_type(mem_pool)),
+                    name(name),
+                    event_id(eid),
+                    test_cast(tc),
+                    model_args(&ma),
+                    listeners(Listeners::allocator_type(mem_pool)),
+                    once(Listeners::allocator_type(mem_pool)),
+                    remote(RemoteListeners::allocator_type(mem_pool)),
+                    forwards(Forwards::allocator_type(mem_pool))
                 {}
 
-                futoin::string name;
+                futoin::string name_storage;
+                const char* name;
                 EventID event_id;
                 TestCast test_cast;
                 const NextArgs* model_args;
                 Listeners listeners;
+                // Ring buffer of power of two size
                 Listeners once;
-                ListenerSize once_next{0};
+                SlotID once_head{0};
+                SlotID once_tail{0};
+                RemoteListeners remote;
+                Forwards forwards;
                 ListenerSize pending{0};
+                ListenerSize tombstones{0};
+                // Cancelled once listeners still in ring
+                SlotID once_tombstones{0};
+                ListenerSize remote_tombstones{0};
+                ListenerSize forward_tombstones{0};
                 bool in_process{false};
+                bool coalesce{false};
+                Priority priority{Priority::normal};
+                OverflowPolicy overflow{OverflowPolicy::drop_newest};
+                // 0 - emitter default
+                SizeType max_pending{0};
+                // Chain of queued tasks which have not started yet
+                EmitTask* oldest_queued{nullptr};
+                EmitTask* newest_queued{nullptr};
+                std::unique_ptr<RateLimiter> rate_limiter;
+                // Allocated on the first sample
+                std::unique_ptr<Timing> timing;
+                METRICS_ONLY(Metrics metrics;)
             };
 
-            struct EmitTask
+            // Throttle & debounce state, suppressed emits only keep args
+            struct RateLimiter
             {
-                EmitTask(EventInfo& ei, NextArgs&& args) noexcept :
-                    listeners_count(ei.listeners.size()),
-                    once_count(ei.once_next),
-                    args(std::forward<NextArgs>(args)),
-                    event_info(ei)
+                RateLimiter(
+                        Impl& impl,
+                        EventInfo& ei,
+                        RateLimit mode,
+                        std::chrono::milliseconds interval) noexcept :
+                    impl(impl),
+                    event_info(ei),
+                    mode(mode),
+                    interval(interval)
+                {}
+
+                ~RateLimiter() noexcept
                 {
-                    ei.once_next = 0;
+                    timer.cancel();
                 }
 
-                void operator()() noexcept
+                // False, if emit is held back
+                bool pass(NextArgs* new_args) noexcept
                 {
-                    event_info.in_process = true;
+                    if (firing) {
+                        return true;
+                    }
 
-                    // NOTE: iterators get invalidated!
+                    switch (mode) {
+                    case RateLimit::throttle:
+                        if (!armed) {
+                            arm(interval);
+                            return true;
+                        }
+                        break;
+                    case RateLimit::debounce:
+                        last_emit = Clock::now();
 
-                    // Run through persistent listeners
-                    auto& listeners = event_info.listeners;
+                        if (!armed) {
+                            arm(interval);
+                        }
+                        break;
+                    case RateLimit::none:
+                        return true;
+                    }
 
-                    for (ListenerSize i = 0; i < listeners_count; ++i) {
-                        auto hp = listeners[i];
+                    with_args = (new_args != nullptr);
 
-                        if (hp != nullptr) {
-                            (*hp)(args);
-                        }
+                    if (with_args) {
+                        args = std::move(*new_args);
                     }
 
-                    // Process once
-                    if (once_count > 0) {
-                        auto& once = event_info.once;
+                    held = true;
+                    return false;
+                }
 
-                        for (ListenerSize i = 0; i < once_count; ++i) {
-                            auto hp = once[i];
+                void arm(std::chrono::milliseconds delay) noexcept
+                {
+                    armed = true;
+                    timer = impl.async_tool.deferred(delay, std::ref(*this));
+                }
 
-                            if (hp != nullptr) {
-                                Accessor::event_id(*hp) = NO_EVENT_ID;
-                                (*hp)(args);
-                            }
+                void operator()() noexcept
+                {
+                    armed = false;
+
+                    if (mode == RateLimit::debounce) {
+                        const auto quiet = Clock::now() - last_emit;
+
+                        // NOTE: re-armed only once per interval, not per emit
+                        if (quiet < interval) {
+                            arm(std::chrono::duration_cast<
+                                        std::chrono::milliseconds>(
+                                            interval - quiet)
+                                + std::chrono::milliseconds(1));
+                            return;
                         }
+                    }
 
-                        // Leave new handlers appeared after this call
-                        once.erase(once.begin(), once.begin() + once_count);
+                    if (!held) {
+                        return;
                     }
 
-                    //---
-                    --(event_info.pending);
-                    event_info.in_process = false;
+                    held = false;
+
+                    // Trailing emit of throttle starts the next interval
+                    if (mode == RateLimit::throttle) {
+                        arm(interval);
+                    }
+
+                    firing = true;
+                    impl.call_listeners(
+                            event_info, with_args ? &args : nullptr);
+                    firing = false;
                 }
 
-                const ListenerSize listeners_count;
-                const ListenerSize once_count;
-                const NextArgs args;
+                Impl& impl;
                 EventInfo& event_info;
+                const RateLimit mode;
+                const std::chrono::milliseconds interval;
+                NextArgs args;
+                bool with_args{false};
+                bool held{false};
+                bool armed{false};
+                bool firing{false};
+                Clock::time_point last_emit;
+                IAsyncTool::Handle timer;
             };
 
-            Impl(IAsyncTool& async_tool) noexcept : async_tool(async_tool) {}
-            ~Impl() noexcept
+            using NameIndex = std::unordered_map<
+                    const char*,
+                    EventInfo*,
+                    NameHash,
+                    NameEqual,
+                    PoolAllocator<std::pair<const char* const, EventInfo*>>>;
+
+            // NOTE: args are constructed only for emits with arguments,
+            //       plain signals skip NextArgs entirely
+            struct EmitTask
             {
-                if (!tasks.empty()) {
-                    FatalMsg()
-                            << "EventEmitter destruction with pending tasks!";
+                EmitTask(
+                        EventInfo& ei,
+                        NextArgs* args,
+                        Clock::time_point queued_at = {}) noexcept :
+                    listeners_count(ei.listeners.size()),
+                    remote_count(ei.remote.size()),
+                    once_end(ei.once_tail),
+                    event_info(ei),
+                    queued_at(queued_at)
+                {
+                    if (args != nullptr) {
+                        new (&args_storage) NextArgs(std::move(*args));
+                        with_args = true;
+                    }
                 }
-            }
 
-            EventInfo& get_event_info(
-                    EventEmitter& ee, const EventType& et) noexcept
-            {
-                const auto event_id = Accessor::event_id(et);
+                EmitTask(const EmitTask&) = delete;
+                EmitTask& operator=(const EmitTask&) = delete;
 
-                if (event_id == NO_EVENT_ID) {
-                    // Slow path
-                    futoin::string name{Accessor::raw_event_type(et)};
+                ~EmitTask() noexcept
+                {
+                    if (with_args) {
+                        args().~NextArgs();
+                    }
+                }
+
+                NextArgs& args() noexcept
+                {
+                    return *reinterpret_cast<NextArgs*>(&args_storage);
+                }
 
-                    for (auto& er : events) {
-                        if (er.name == name) {
-                            return er;
+                // Act as if emitted now
+                void coalesce(NextArgs* new_args) noexcept
+                {
+                    listeners_count = event_info.listeners.size();
+                    remote_count = event_info.remote.size();
+                    once_end = event_info.once_tail;
+                    batch.reset();
+
+                    if (new_args == nullptr) {
+                        if (with_args) {
+                            args().~NextArgs();
+                            with_args = false;
                         }
+                    } else if (with_args) {
+                        args() = std::move(*new_args);
+                    } else {
+                        new (&args_storage) NextArgs(std::move(*new_args));
+                        with_args = true;
                     }
-
-                    FatalMsg() << "unknown event type: " << name;
                 }
 
-                if (Accessor::event_emitter(et) != &ee) {
-                    FatalMsg() << "foreign event type!";
+                void operator()(Impl& impl) noexcept
+                {
+                    event_info.in_process = true;
+
+                    // NOTE: inline emit is not in the chain
+                    if (event_info.oldest_queued == this) {
+                        event_info.oldest_queued = next_queued;
+
+                        if (next_queued == nullptr) {
+                            event_info.newest_queued = nullptr;
+                        }
+                    }
+
+                    // NOTE: own args go after the batch
+                    if (batch != nullptr) {
+                        for (auto& batch_args : *batch) {
+                            deliver(impl, &batch_args);
+                        }
+                    }
+
+                    deliver(impl, with_args ? &args() : nullptr);
+
+                    //---
+                    --(event_info.pending);
+                    event_info.in_process = false;
                 }
 
-                return events[event_id - 1];
-            }
+                void deliver(Impl& impl, NextArgs* own_args) noexcept
+                {
+                    Relays relays(Relays::allocator_type(impl.mem_pool));
+                    deliver_local(
+                            impl,
+                            (own_args != nullptr) ? *own_args : impl.no_args,
+                            relays);
+
+                    // Last as args get moved
+                    std::shared_ptr<const NextArgs> shared_args;
+
+                    if (remote_count != 0) {
+                        impl.call_remote(
+                                event_info,
+                                remote_count,
+                                shared_args,
+                                own_args);
+                    }
 
-            EventInfo& process_new_handler(
-                    EventEmitter& ee,
-                    const EventType& et,
-                    EventHandler& handler) noexcept
-            {
-                if (Accessor::event_id(handler) != NO_EVENT_ID) {
-                    FatalMsg() << "handler re-use is not supported!";
+                    for (auto& r : relays) {
+                        r.target->call_remote(
+                                *(r.event_info),
+                                r.remote_count,
+                                shared_args,
+                                own_args);
+                        r.target->end_relay(*(r.event_info));
+                    }
                 }
 
-                auto& ei = get_event_info(ee, et);
+                void deliver_local(
+                        Impl& impl,
+                        const NextArgs& args,
+                        Relays& relays) noexcept
+                {
+                    // NOTE: iterators get invalidated!
 
-                handler.test_cast()(*(ei.model_args));
+                    // Run through persistent listeners
+                    auto& listeners = event_info.listeners;
+                    const bool timed = impl.sample_timing();
 
-                auto& handler_et = Accessor::event_type(handler);
-                Accessor::event_id(handler_et) = ei.event_id;
-                Accessor::event_emitter(handler_et) = &ee;
-                return ei;
-            }
+                    for (ListenerSize i = 0; i < listeners_count; ++i) {
+                        auto hp = listeners[i];
 
-            void call_listeners(EventInfo& ei, NextArgs&& args = {}) noexcept
-            {
-                if (ei.in_process) {
-                    FatalMsg() << "emit() recursion for: " << ei.name;
-                }
+                        if (hp == nullptr) {
+                            continue;
+                        }
+
+                        METRICS_ONLY(event_info.metrics.deliveries.add());
+
+                        if (timed) {
+                            const auto start = Clock::now();
+                            (*hp)(args);
+                            impl.record_timing(
+                                    event_info, i, Clock::now() - start);
+                        } else {
+                            (*hp)(args);
+                        }
+                    }
+
+                    // Process once, leave handlers appeared after emit
+                    auto& once = event_info.once;
+                    auto& once_head = event_info.once_head;
+
+                    for (; once_head != once_end; ++once_head) {
+                        auto& slot = once[once_head & (once.size() - 1)];
+                        auto hp = slot;
+
+                        if (hp != nullptr) {
+                            slot = nullptr;
+                            impl.listener_slots.erase(hp);
+                            Accessor::event_id(*hp) = NO_EVENT_ID;
+                            METRICS_ONLY(
+                                    event_info.metrics.once_deliveries.add());
+                            (*hp)(args);
+                        } else {
+                            --(event_info.once_tombstones);
+                        }
+                    }
+
+                    if (!impl.any_listeners.empty()) {
+                        impl.call_any(event_info, args);
+                    }
+
+                    auto& forwards = event_info.forwards;
+
+                    for (std::size_t i = 0, count = forwards.size(); i < count;
+                         ++i) {
+                        const auto fwd = forwards[i];
+
+                        if (fwd.event_info != nullptr) {
+                            fwd.target->relay(*(fwd.event_info), args, relays);
+                        }
+                    }
+                }
+
+                ListenerSize listeners_count;
+                ListenerSize remote_count;
+                SlotID once_end;
+                bool with_args{false};
+                typename std::aligned_storage<sizeof(NextArgs),
+                                              alignof(NextArgs)>::type
+                        args_storage;
+                // Packs delivered before args by emit_batch()
+                Batch batch;
+                EventInfo& event_info;
+                Clock::time_point queued_at;
+                EmitTask* next_queued{nullptr};
+            };
+
+            // FIFO with stable task addresses and recycled slots
+            class TaskQueue
+            {
+            public:
+                TaskQueue(IMemPool& mem_pool) noexcept : mem_pool_(mem_pool) {}
+                TaskQueue(const TaskQueue&) = delete;
+                TaskQueue& operator=(const TaskQueue&) = delete;
+
+                ~TaskQueue() noexcept
+                {
+                    while (!empty()) {
+                        pop_front();
+                    }
+
+                    while (free_ != nullptr) {
+                        auto slot = free_;
+                        free_ = slot->next;
+                        mem_pool_.deallocate(slot, sizeof(Slot), 1);
+                    }
+                }
+
+                bool empty() const noexcept
+                {
+                    return head_ == nullptr;
+                }
+
+                EmitTask& front() noexcept
+                {
+                    return head_->task();
+                }
+
+                EmitTask& emplace_back(
+                        EventInfo& ei,
+                        NextArgs* args,
+                        Clock::time_point queued_at) noexcept
+                {
+                    Slot* slot = free_;
+
+                    if (slot != nullptr) {
+                        free_ = slot->next;
+                    } else {
+                        slot = new (mem_pool_.allocate(sizeof(Slot), 1)) Slot;
+                    }
+
+                    new (&(slot->storage)) EmitTask(ei, args, queued_at);
+                    slot->prev = tail_;
+                    slot->next = nullptr;
+
+                    if (tail_ != nullptr) {
+                        tail_->next = slot;
+                    } else {
+                        head_ = slot;
+                    }
+
+                    tail_ = slot;
+                    return slot->task();
+                }
+
+                void pop_front() noexcept
+                {
+                    erase(front());
+                }
+
+                void erase(EmitTask& task) noexcept
+                {
+                    // NOTE: storage is the first member
+                    auto slot = reinterpret_cast<Slot*>(&task);
+
+                    if (slot->prev != nullptr) {
+                        slot->prev->next = slot->next;
+                    } else {
+                        head_ = slot->next;
+                    }
+
+                    if (slot->next != nullptr) {
+                        slot->next->prev = slot->prev;
+                    } else {
+                        tail_ = slot->prev;
+                    }
+
+                    task.~EmitTask();
+                    slot->next = free_;
+                    free_ = slot;
+                }
+
+            private:
+                struct Slot
+                {
+                    EmitTask& task() noexcept
+                    {
+                        return *reinterpret_cast<EmitTask*>(&storage);
+                    }
+
+                    typename std::aligned_storage<
+                            sizeof(EmitTask),
+                            alignof(EmitTask)>::type storage;
+                    Slot* prev;
+                    Slot* next;
+                };
+
+                IMemPool& mem_pool_;
+                Slot* head_{nullptr};
+                Slot* tail_{nullptr};
+                Slot* free_{nullptr};
+            };
+
+            struct Lane
+            {
+                Lane(IMemPool& mem_pool) noexcept : tasks(mem_pool) {}
+
+                TaskQueue tasks;
+                LaneStats stats;
+            };
+
+            using Lanes = std::array<Lane, PRIORITY_COUNT>;
+
+            // Calls made outside of event loop thread
+            struct ForeignCall
+            {
+                enum class Kind : std::uint8_t
+                {
+                    on,
+                    once,
+                    signal,
+                    emit,
+                    emit_checked,
+                    emit_batch,
+                };
+
+                ForeignCall(
+                        Kind kind,
+                        EventID eid,
+                        EventHandler* handler,
+                        NextArgs&& args,
+                        IAsyncTool* target) noexcept :
+                    kind(kind),
+                    event_id(eid),
+                    handler(handler),
+                    target(target),
+                    args(std::forward<NextArgs>(args))
+                {}
+
+                const Kind kind;
+                const EventID event_id;
+                EventHandler* const handler;
+                IAsyncTool* const target;
+                NextArgs args;
+                Batch batch;
+                ForeignCall* next{nullptr};
+            };
+
+            struct ForeignDrain
+            {
+                void operator()() noexcept
+                {
+                    impl.drain_foreign();
+                }
+
+                Impl& impl;
+            };
+
+            Impl(EventEmitter& ee,
+                 IAsyncTool& async_tool,
+                 IMemPool& mem_pool,
+                 const EventSchema* schema) noexcept :
+                ee(ee),
+                async_tool(async_tool),
+                mem_pool(mem_pool),
+                schema(schema),
+                events(EventAllocator(mem_pool)),
+                event_names(
+                        0,
+                        NameHash(),
+                        NameEqual(),
+                        NameIndex::allocator_type(mem_pool)),
+                lanes{{{mem_pool}, {mem_pool}, {mem_pool}}},
+                listener_slots(mem_pool),
+                any_listeners(AnyListeners::allocator_type(mem_pool))
+            {}
+
+            ~Impl() noexcept
+            {
+                // NOTE: inline dispatch of foreign emits and drop_oldest
+                //       may leave scheduled dispatch without tasks
+                if ((next_lane() != nullptr) || (scheduled != 0)) {
+                    FatalMsg()
+                            << "EventEmitter destruction with pending tasks!";
+                }
+
+                if (foreign_head.load() != nullptr) {
+                    FatalMsg() << "EventEmitter destruction with pending "
+                                  "foreign thread calls!";
+                }
+
+                // NOTE: in-flight remote calls hold own references
+                for (auto& ei : events) {
+                    for (auto rl : ei.remote) {
+                        if (rl != nullptr) {
+                            rl->active = false;
+                            rl->release();
+                        }
+                    }
+                }
+            }
+
+            EventInfo& get_event_info(const EventType& et) noexcept
+            {
+                const auto event_id = Accessor::event_id(et);
+
+                if (event_id == NO_EVENT_ID) {
+                    // Slow path
+                    const auto name = Accessor::raw_event_type(et);
+                    auto iter = event_names.find(name);
+
+                    if (iter != event_names.end()) {
+                        return *(iter->second);
+                    }
+
+                    if (schema != nullptr) {
+                        auto& names = schema->impl_->names;
+                        auto siter = names.find(name);
+
+                        if (siter != names.end()) {
+                            return event_at(siter->second);
+                        }
+                    }
+
+                    FatalMsg() << "unknown event type: " << name;
+                }
+
+                if (!is_own(et)) {
+                    FatalMsg() << "foreign event type!";
+                }
+
+                return event_at(event_id);
+            }
+
+            bool is_own(const EventType& et) const noexcept
+            {
+                const auto emitter = Accessor::event_emitter(et);
+                return (emitter == &ee)
+                       || ((emitter == schema) && (schema != nullptr));
+            }
+
+            EventInfo& event_at(EventID event_id) noexcept
+            {
+                if (event_id > events.size()) {
+                    materialize(event_id);
+                }
+
+                return events[event_id - 1];
+            }
+
+            // Set up schema events up to the ID on first use
+            void materialize(std::size_t count) noexcept
+            {
+                auto& entries = schema->impl_->entries;
+
+                METRICS_ONLY(std::lock_guard<std::mutex> lock(metrics_mutex);)
+
+                for (auto i = events.size(); i < count; ++i) {
+                    auto& entry = entries[i];
+                    events.emplace_back(
+                            entry.name.c_str(),
+                            i + 1,
+                            entry.test_cast,
+                            *(entry.model_args),
+                            mem_pool);
+
+                    apply_options(events.back(), entry.options);
+                }
+            }
+
+            void apply_options(
+                    EventInfo& ei, const EventOptions& options) noexcept
+            {
+                flush_rate_limiter(ei);
+
+                ei.coalesce = options.coalesce;
+                ei.priority = options.priority;
+                ei.max_pending = options.max_pending;
+                ei.overflow = options.overflow;
+
+                if ((options.rate_limit != RateLimit::none)
+                    && (options.rate_interval.count() > 0)) {
+                    ei.rate_limiter.reset(new RateLimiter(
+                            *this,
+                            ei,
+                            options.rate_limit,
+                            options.rate_interval));
+                } else {
+                    ei.rate_limiter.reset();
+                }
+            }
+
+            // Deliver held emit under current options
+            void flush_rate_limiter(EventInfo& ei) noexcept
+            {
+                if ((ei.rate_limiter == nullptr) || !ei.rate_limiter->held) {
+                    return;
+                }
+
+                std::unique_ptr<RateLimiter> limiter{ei.rate_limiter.release()};
+                limiter->held = false;
+
+                // NOTE: no pending emits, so it runs right away
+                call_listeners_now(
+                        ei, limiter->with_args ? &(limiter->args) : nullptr);
+            }
+
+            EventInfo& process_new_handler(
+                    const EventType& et, EventHandler& handler) noexcept
+            {
+                return process_new_handler(get_event_info(et), handler);
+            }
+
+            EventInfo& process_new_handler(
+                    EventInfo& ei, EventHandler& handler) noexcept
+            {
+                if (Accessor::event_id(handler) != NO_EVENT_ID) {
+                    FatalMsg() << "handler re-use is not supported!";
+                }
+
+                handler.test_cast()(*(ei.model_args));
+
+                auto& handler_et = Accessor::event_type(handler);
+                Accessor::event_id(handler_et) = ei.event_id;
+                Accessor::event_emitter(handler_et) = &ee;
+                return ei;
+            }
+
+            void add_listener(EventInfo& ei, EventHandler& handler) noexcept
+            {
+                auto& listeners = ei.listeners;
+
+                compact_listeners(ei);
+
+                assert(listeners.size()
+                       != std::numeric_limits<ListenerSize>::max());
+
+                if ((listeners.size() - ei.tombstones) == max_listeners) {
+                    FatalMsgHook::stream()
+                            << "WARN: reached max event listeners: " << ei.name
+                            << std::endl;
+                }
+
+                listener_slots.set(&handler, listeners.size());
+                listeners.emplace_back(&handler);
+            }
+
+            bool remove_listener(
+                    EventInfo& ei,
+                    EventHandler& handler,
+                    RemoteListener*& detached) noexcept
+            {
+                auto slot_p = listener_slots.find(&handler);
+
+                if (slot_p == nullptr) {
+                    return remove_remote(ei, handler, detached);
+                }
+
+                auto& listeners = ei.listeners;
+                const auto slot = *slot_p;
+
+                if ((slot < listeners.size())
+                    && (listeners[slot] == &handler)) {
+                    // NOTE: pending tasks rely on slot positions
+                    listeners[slot] = nullptr;
+
+                    if ((ei.timing != nullptr)
+                        && (slot < ei.timing->listeners.size())) {
+                        ei.timing->listeners[slot] = HandlerTiming();
+                    }
+                    listener_slots.erase(&handler);
+                    ++(ei.tombstones);
+                    METRICS_ONLY(ei.metrics.tombstones.add());
+
+                    compact_listeners(ei);
+                    return true;
+                }
+
+                auto& once = ei.once;
+
+                if (((slot - ei.once_head) < (ei.once_tail - ei.once_head))
+                    && (once[slot & (once.size() - 1)] == &handler)) {
+                    once[slot & (once.size() - 1)] = nullptr;
+                    listener_slots.erase(&handler);
+                    ++(ei.once_tombstones);
+                    METRICS_ONLY(ei.metrics.tombstones.add());
+
+                    compact_listeners(ei);
+                    return true;
+                }
+
+                return false;
+            }
+
+            // NOTE: expected to be a few, so linear search
+            // NOTE: list reference goes to detached for wait of running call
+            bool remove_remote(
+                    EventInfo& ei,
+                    EventHandler& handler,
+                    RemoteListener*& detached) noexcept
+            {
+                for (auto& rl : ei.remote) {
+                    if ((rl != nullptr) && (&(rl->handler) == &handler)) {
+                        rl->active.store(false, std::memory_order_release);
+                        detached = rl;
+                        rl = nullptr;
+                        ++(ei.remote_tombstones);
+                        METRICS_ONLY(ei.metrics.tombstones.add());
+
+                        compact_listeners(ei);
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            // Amortized: runs only when at least half of slots are dead
+            void compact_listeners(EventInfo& ei) noexcept
+            {
+                if (ei.pending != 0) {
+                    return;
+                }
+
+                if ((ei.forward_tombstones != 0) && !ei.in_process) {
+                    auto& forwards = ei.forwards;
+                    forwards.erase(
+                            std::remove_if(
+                                    forwards.begin(),
+                                    forwards.end(),
+                                    [](const Forward& f) {
+                                        return f.event_info == nullptr;
+                                    }),
+                            forwards.end());
+                    ei.forward_tombstones = 0;
+                }
+
+                compact_once(ei);
+
+                if (ei.remote_tombstones != 0) {
+                    auto& remote = ei.remote;
+                    remote.erase(
+                            std::remove(remote.begin(), remote.end(), nullptr),
+                            remote.end());
+                    ei.remote_tombstones = 0;
+                }
+
+                auto& listeners = ei.listeners;
+
+                if ((ei.tombstones == 0)
+                    || ((ei.tombstones * 2U) < listeners.size())) {
+                    return;
+                }
+
+                ListenerSize pos = 0;
+                auto timing = ei.timing.get();
+
+                if (timing != nullptr) {
+                    timing->listeners.resize(listeners.size());
+                }
+
+                for (ListenerSize i = 0; i < listeners.size(); ++i) {
+                    auto hp = listeners[i];
+
+                    if (hp != nullptr) {
+                        if (i != pos) {
+                            listeners[pos] = hp;
+                            listener_slots.set(hp, pos);
+
+                            // Stats follow the listener
+                            if (timing != nullptr) {
+                                timing->listeners[pos] =
+                                        timing->listeners[i];
+                            }
+                        }
+
+                        ++pos;
+                    }
+                }
+
+                listeners.resize(pos);
+                ei.tombstones = 0;
+
+                if (timing != nullptr) {
+                    timing->listeners.resize(pos);
+                }
+            }
+
+            // Cancelled slots are skipped only by emits, so rarely
+            // emitted events need it on off() as well
+            void compact_once(EventInfo& ei) noexcept
+            {
+                const SlotID once_size = ei.once_tail - ei.once_head;
+
+                if ((ei.once_tombstones == 0)
+                    || ((ei.once_tombstones * 2U) < once_size)) {
+                    return;
+                }
+
+                auto& once = ei.once;
+                const auto mask = once.size() - 1;
+                auto pos = ei.once_head;
+
+                // NOTE: pos never passes seq, so unread slots stay intact
+                for (auto seq = ei.once_head; seq != ei.once_tail; ++seq) {
+                    auto hp = once[seq & mask];
+
+                    if (hp != nullptr) {
+                        if (pos != seq) {
+                            once[pos & mask] = hp;
+                            listener_slots.set(hp, pos);
+                        }
+
+                        ++pos;
+                    }
+                }
+
+                for (auto seq = pos; seq != ei.once_tail; ++seq) {
+                    once[seq & mask] = nullptr;
+                }
+
+                ei.once_tail = pos;
+                ei.once_tombstones = 0;
+            }
+
+            void add_once(EventInfo& ei, EventHandler& handler) noexcept
+            {
+                auto& once = ei.once;
+                const SlotID once_size = ei.once_tail - ei.once_head;
+                const SlotID live = once_size - ei.once_tombstones;
+
+                assert(live != std::numeric_limits<ListenerSize>::max());
+
+                if (live == max_listeners) {
+                    FatalMsgHook::stream()
+                            << "WARN: reached max event once listeners: "
+                            << ei.name << std::endl;
+                }
+
+                if (once_size == once.size()) {
+                    Listeners grown(
+                            std::max<std::size_t>(once.size() * 2U, 4U),
+                            nullptr,
+                            once.get_allocator());
+
+                    for (auto seq = ei.once_head; seq != ei.once_tail; ++seq) {
+                        grown[seq & (grown.size() - 1)] =
+                                once[seq & (once.size() - 1)];
+                    }
+
+                    once.swap(grown);
+                }
+
+                once[ei.once_tail & (once.size() - 1)] = &handler;
+                listener_slots.set(&handler, ei.once_tail);
+                ++(ei.once_tail);
+            }
+
+            void add_remote(
+                    EventInfo& ei,
+                    EventHandler& handler,
+                    IAsyncTool& target,
+                    bool once) noexcept
+            {
+                auto& remote = ei.remote;
+
+                assert(remote.size()
+                       != std::numeric_limits<ListenerSize>::max());
+
+                if ((remote.size() - ei.remote_tombstones) == max_listeners) {
+                    FatalMsgHook::stream()
+                            << "WARN: reached max event remote listeners: "
+                            << ei.name << std::endl;
+                }
+
+                remote.emplace_back(new RemoteListener(handler, target, once));
+            }
+
+            // NOTE: signals share the same empty args
+            std::shared_ptr<const NextArgs> share_args(NextArgs* args) noexcept
+            {
+                if (args != nullptr) {
+                    return std::make_shared<const NextArgs>(std::move(*args));
+                }
+
+                if (!shared_no_args) {
+                    shared_no_args = std::make_shared<const NextArgs>();
+                }
+
+                return shared_no_args;
+            }
+
+            void call_remote(
+                    EventInfo& ei,
+                    ListenerSize count,
+                    std::shared_ptr<const NextArgs>& shared_args,
+                    NextArgs* args) noexcept
+            {
+                for (ListenerSize i = 0; i < count; ++i) {
+                    auto& rl = ei.remote[i];
+
+                    if (rl == nullptr) {
+                        continue;
+                    }
+
+                    if (!shared_args) {
+                        shared_args = share_args(args);
+                    }
+
+                    auto call = new RemoteCall{rl, shared_args};
+
+                    METRICS_ONLY(ei.metrics.deliveries.add());
+
+                    if (rl->once) {
+                        // NOTE: list reference goes to the call
+                        Accessor::event_id(rl->handler) = NO_EVENT_ID;
+                        rl = nullptr;
+                        ++(ei.remote_tombstones);
+                    } else {
+                        rl->refs.fetch_add(1, std::memory_order_relaxed);
+                    }
+
+                    call->listener->target.immediate([call]() { call->run(); });
+                }
+            }
+
+            void add_any(AnyEventHandler& handler) noexcept
+            {
+                auto& any = any_listeners;
+
+                if (std::find(any.begin(), any.end(), &handler) != any.end()) {
+                    FatalMsg() << "handler re-use is not supported!";
+                }
+
+                assert(any.size() != std::numeric_limits<ListenerSize>::max());
+
+                if ((any.size() - any_tombstones) == max_listeners) {
+                    FatalMsgHook::stream()
+                            << "WARN: reached max any-event listeners"
+                            << std::endl;
+                }
+
+                any.emplace_back(&handler);
+            }
+
+            bool remove_any(AnyEventHandler& handler) noexcept
+            {
+                auto& any = any_listeners;
+                auto iter = std::find(any.begin(), any.end(), &handler);
+
+                if (iter == any.end()) {
+                    return false;
+                }
+
+                *iter = nullptr;
+                ++any_tombstones;
+                compact_any();
+                return true;
+            }
+
+            void compact_any() noexcept
+            {
+                // NOTE: running loop relies on positions
+                if ((any_depth != 0) || (any_tombstones == 0)) {
+                    return;
+                }
+
+                auto& any = any_listeners;
+                any.erase(
+                        std::remove(any.begin(), any.end(), nullptr),
+                        any.end());
+                any_tombstones = 0;
+            }
+
+            void add_forward(
+                    EventInfo& ei, Impl& target, EventInfo& target_ei) noexcept
+            {
+                for (const auto& f : ei.forwards) {
+                    if ((f.target == &target) && (f.event_info == &target_ei)) {
+                        FatalMsg() << "Double forward of event: " << ei.name;
+                    }
+                }
+
+                ei.forwards.push_back(Forward{&target, &target_ei});
+            }
+
+            bool remove_forward(
+                    EventInfo& ei, Impl& target, EventInfo& target_ei) noexcept
+            {
+                for (auto& f : ei.forwards) {
+                    if ((f.target == &target) && (f.event_info == &target_ei)) {
+                        // NOTE: dispatch may iterate forwards
+                        f.event_info = nullptr;
+                        ++(ei.forward_tombstones);
+                        compact_listeners(ei);
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            // Forwarded emit runs within dispatch of the source event
+            void relay(
+                    EventInfo& ei,
+                    const NextArgs& args,
+                    Relays& relays) noexcept
+            {
+                if (ei.in_process) {
+                    FatalMsg() << "emit() recursion for: " << ei.name;
+                }
+
+                METRICS_ONLY(ei.metrics.emits.add());
+
+                if (listener_count(ei) == 0) {
+                    return;
+                }
+
+                // NOTE: holds compaction while slots are in use
+                ++(ei.pending);
+
+                EmitTask task(ei, nullptr);
+
+                // Once listeners of queued emits must stay for them
+                if (ei.oldest_queued != nullptr) {
+                    task.once_end = ei.oldest_queued->once_end;
+                }
+
+                ei.in_process = true;
+                task.deliver_local(*this, args, relays);
+                ei.in_process = false;
+
+                if (task.remote_count != 0) {
+                    relays.push_back(Relay{this, &ei, task.remote_count});
+                } else {
+                    end_relay(ei);
+                }
+            }
+
+            void end_relay(EventInfo& ei) noexcept
+            {
+                --(ei.pending);
+                compact_listeners(ei);
+            }
+
+            // True for every N-th dispatch, if enabled
+            bool sample_timing() noexcept
+            {
+                if (listener_timing.sample_every == 0) {
+                    return false;
+                }
+
+                if (timing_countdown != 0) {
+                    --timing_countdown;
+                    return false;
+                }
+
+                timing_countdown = listener_timing.sample_every - 1;
+                return true;
+            }
+
+            void record_timing(
+                    EventInfo& ei,
+                    ListenerSize index,
+                    Clock::duration elapsed) noexcept
+            {
+                if (ei.timing == nullptr) {
+                    ei.timing.reset(new Timing);
+                }
+
+                auto& listeners = ei.timing->listeners;
+
+                if (listeners.size() <= index) {
+                    listeners.resize(ei.listeners.size());
+                }
+
+                const auto ns =
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                elapsed);
+                add_sample(ei.timing->total, ns);
+                add_sample(listeners[index], ns);
+
+                const auto budget = listener_timing.budget;
+
+                if ((budget.count() == 0) || (ns <= budget)) {
+                    return;
+                }
+
+                if (listener_timing.on_slow) {
+                    listener_timing.on_slow(ei.name, index, ns);
+                } else {
+                    FatalMsgHook::stream()
+                            << "WARN: slow listener #" << index
+                            << " of event: " << ei.name << " took "
+                            << ns.count() << "ns" << std::endl;
+                }
+            }
+
+            static void add_sample(
+                    HandlerTiming& ht, std::chrono::nanoseconds ns) noexcept
+            {
+                ++(ht.samples);
+                ht.total += ns;
+                ht.max = std::max(ht.max, ns);
+            }
+
+            void call_any(EventInfo& ei, const NextArgs& args) noexcept
+            {
+                auto& any = any_listeners;
+                ++any_depth;
+
+                // Handlers added by handlers get only the next event
+                for (ListenerSize i = 0, count = any.size(); i < count; ++i) {
+                    auto hp = any[i];
+
+                    if (hp != nullptr) {
+                        METRICS_ONLY(ei.metrics.deliveries.add());
+                        (*hp)(ei.event_id, ei.name, args);
+                    }
+                }
+
+                --any_depth;
+                compact_any();
+            }
+
+            std::size_t listener_count(const EventInfo& ei) const noexcept
+            {
+                return (ei.listeners.size() - ei.tombstones)
+                       + (ei.once_tail - ei.once_head - ei.once_tombstones)
+                       + (ei.remote.size() - ei.remote_tombstones)
+                       + (ei.forwards.size() - ei.forward_tombstones)
+                       + (any_listeners.size() - any_tombstones);
+            }
+
+            // Unobserved emit costs only the check
+            bool skip_unobserved(EventInfo& ei) noexcept
+            {
+                if (listener_count(ei) != 0) {
+                    return false;
+                }
+
+                METRICS_ONLY(ei.metrics.emits.add());
+                return true;
+            }
+
+            enum class QueueResult : std::uint8_t
+            {
+                // New task needs dispatch
+                queued,
+                // No listeners, merged or dropped
+                skipped,
+                rejected,
+            };
+
+            // NOTE: no args for a plain signal
+            QueueResult queue_task(
+                    EventInfo& ei,
+                    NextArgs* args = nullptr,
+                    Batch&& batch = {}) noexcept
+            {
+                if (ei.in_process) {
+                    FatalMsg() << "emit() recursion for: " << ei.name;
+                }
+
+                METRICS_ONLY(ei.metrics.emits.add());
+
+                if (listener_count(ei) == 0) {
+                    return QueueResult::skipped;
+                }
+
+                if ((ei.rate_limiter != nullptr)
+                    && !ei.rate_limiter->pass(args)) {
+                    return QueueResult::skipped;
+                }
+
+                if (ei.coalesce && (ei.newest_queued != nullptr)) {
+                    ei.newest_queued->coalesce(args);
+                    ++(queue_stats.coalesced);
+                    return QueueResult::skipped;
+                }
+
+                auto& lane = lanes[static_cast<std::size_t>(ei.priority)];
+                bool replaced = false;
+
+                if (ei.pending >= pending_limit(ei)) {
+                    // Only the internal limit, if not configured
+                    if ((ei.max_pending == 0) && (max_pending == 0)) {
+                        assert(ei.pending < pending_limit(ei));
+                        ++(queue_stats.dropped);
+                        return QueueResult::skipped;
+                    }
+
+                    const auto policy = (ei.max_pending != 0) ? ei.overflow
+                                                              : overflow;
+
+                    switch (policy) {
+                    case OverflowPolicy::drop_newest:
+                        ++(queue_stats.dropped);
+                        return QueueResult::skipped;
+                    case OverflowPolicy::drop_oldest:
+                        if (ei.oldest_queued == nullptr) {
+                            ++(queue_stats.dropped);
+                            return QueueResult::skipped;
+                        }
+
+                        drop_oldest(ei, lane);
+                        replaced = true;
+                        break;
+                    case OverflowPolicy::coalesce:
+                        if (ei.newest_queued == nullptr) {
+                            ++(queue_stats.dropped);
+                            return QueueResult::skipped;
+                        }
+
+                        ei.newest_queued->coalesce(args);
+                        ++(queue_stats.coalesced);
+                        return QueueResult::skipped;
+                    case OverflowPolicy::fail:
+                        return QueueResult::rejected;
+                    }
+                }
+
+                ++(ei.pending);
+                METRICS_ONLY(ei.metrics.peak_pending.raise(ei.pending));
+
+                auto& task = lane.tasks.emplace_back(
+                        ei,
+                        args,
+                        (WITH_METRICS || lane_timing) ? Clock::now()
+                                                      : Clock::time_point());
+                task.batch = std::move(batch);
+
+                if (ei.newest_queued != nullptr) {
+                    ei.newest_queued->next_queued = &task;
+                } else {
+                    ei.oldest_queued = &task;
+                }
+
+                ei.newest_queued = &task;
+
+                // NOTE: dispatch of the dropped task is already in flight
+                return replaced ? QueueResult::skipped : QueueResult::queued;
+            }
+
+            SizeType pending_limit(const EventInfo& ei) const noexcept
+            {
+                const SizeType hard_limit =
+                        std::numeric_limits<ListenerSize>::max();
+                const auto limit =
+                        (ei.max_pending != 0) ? ei.max_pending : max_pending;
+
+                return ((limit != 0) && (limit < hard_limit)) ? limit
+                                                              : hard_limit;
+            }
+
+            void drop_oldest(EventInfo& ei, Lane& lane) noexcept
+            {
+                auto& task = *(ei.oldest_queued);
+                ei.oldest_queued = task.next_queued;
+
+                if (ei.oldest_queued == nullptr) {
+                    ei.newest_queued = nullptr;
+                }
+
+                lane.tasks.erase(task);
+                --(ei.pending);
+                ++(queue_stats.dropped);
+            }
+
+            bool call_listeners_now(
+                    EventInfo& ei, NextArgs* args = nullptr) noexcept
+            {
+                // Preserve order of already queued emits
+                if ((ei.pending != 0) || (ei.rate_limiter != nullptr)) {
+                    return call_listeners(ei, args);
+                }
+
+                if (ei.in_process) {
+                    FatalMsg() << "emit() recursion for: " << ei.name;
+                }
+
+                ++(ei.pending);
+                METRICS_ONLY(ei.metrics.emits.add());
+                METRICS_ONLY(ei.metrics.peak_pending.raise(ei.pending));
+
+                EmitTask task(ei, args);
+                task(*this);
+                compact_listeners(ei);
+                return true;
+            }
+
+            // False on overflow with OverflowPolicy::fail
+            bool call_listeners(
+                    EventInfo& ei,
+                    NextArgs* args = nullptr,
+                    Batch&& batch = {}) noexcept
+            {
+                switch (queue_task(ei, args, std::move(batch))) {
+                case QueueResult::queued:
+                    break;
+                case QueueResult::skipped:
+                    return true;
+                case QueueResult::rejected:
+                    return false;
+                }
+
+                // NOTE: batch mode needs only a single dispatch in flight
+                if ((dispatch_batch == 1) || (scheduled == 0)) {
+                    schedule();
+                }
+
+                return true;
+            }
+
+            void ensure_queued(EventInfo& ei, bool queued) noexcept
+            {
+                if (!queued) {
+                    FatalMsg() << "event queue overflow: " << ei.name;
+                }
+            }
+
+            void schedule() noexcept
+            {
+                ++scheduled;
+                async_tool.immediate(std::ref(*this));
+            }
+
+            Lane* next_lane() noexcept
+            {
+                for (auto& lane : lanes) {
+                    if (!lane.tasks.empty()) {
+                        return &lane;
+                    }
+                }
+
+                return nullptr;
+            }
+
+            void dispatch(SizeType limit) noexcept
+            {
+                for (auto i = limit; i > 0; --i) {
+                    auto lane = next_lane();
+
+                    if (lane == nullptr) {
+                        break;
+                    }
+
+                    auto& task = lane->tasks.front();
+                    auto& ei = task.event_info;
+
+                    auto& stats = lane->stats;
+                    ++(stats.dispatched);
+
+                    // NOTE: tasks queued before timing got enabled are skipped
+                    if (task.queued_at != Clock::time_point()) {
+                        const auto wait = Clock::now() - task.queued_at;
+
+                        if (lane_timing) {
+                            stats.total_wait += wait;
+                            stats.max_wait = std::max<std::chrono::nanoseconds>(
+                                    stats.max_wait, wait);
+                        }
+
+                        METRICS_ONLY(ei.metrics.record_wait(wait));
+                    }
+
+                    task(*this);
+                    lane->tasks.pop_front();
+                    compact_listeners(ei);
+                }
+
+                // Yield to other loop tasks, but continue on the next tick
+                if ((next_lane() != nullptr) && (scheduled == 0)) {
+                    schedule();
+                }
+            }
+
+            void operator()() noexcept
+            {
+                --scheduled;
+                dispatch(dispatch_batch);
+            }
+
+            // NOTE: may be called from any thread
+            bool post_foreign(
+                    ForeignCall::Kind kind,
+                    const EventType& et,
+                    EventHandler* handler,
+                    NextArgs&& args,
+                    IAsyncTool* target = nullptr,
+                    Batch&& batch = {}) noexcept
+            {
+                const auto event_id = Accessor::event_id(et);
+
+                // Name lookup is not safe outside of event loop thread
+                if ((event_id == NO_EVENT_ID) || !is_own(et)) {
+                    return false;
+                }
+
+                auto fc = new ForeignCall(
+                        kind,
+                        event_id,
+                        handler,
+                        std::forward<NextArgs>(args),
+                        target);
+                fc->batch = std::move(batch);
+
+                fc->next = foreign_head.load(std::memory_order_relaxed);
+
+                while (!foreign_head.compare_exchange_weak(fc->next, fc)) {
+                }
+
+                if (!foreign_scheduled.exchange(true)) {
+                    async_tool.immediate(std::ref(foreign_drain));
+                }
+
+                return true;
+            }
+
+            void drain_foreign() noexcept
+            {
+                // NOTE: must be reset before the queue is taken
+                foreign_scheduled = false;
+
+                // Restore FIFO order of LIFO stack
+                ForeignCall* fc = nullptr;
+
+                for (auto head = foreign_head.exchange(nullptr);
+                     head != nullptr;) {
+                    auto next = head->next;
+                    head->next = fc;
+                    fc = head;
+                    head = next;
+                }
+
+                while (fc != nullptr) {
+                    std::unique_ptr<ForeignCall> done{fc};
+                    auto& ei = event_at(fc->event_id);
+                    fc = fc->next;
+
+                    switch (done->kind) {
+                    case ForeignCall::Kind::on:
+                        process_new_handler(ei, *(done->handler));
+
+                        if (done->target != nullptr) {
+                            add_remote(
+                                    ei,
+                                    *(done->handler),
+                                    *(done->target),
+                                    false);
+                        } else {
+                            add_listener(ei, *(done->handler));
+                        }
+                        break;
+                    case ForeignCall::Kind::once:
+                        process_new_handler(ei, *(done->handler));
+
+                        if (done->target != nullptr) {
+                            add_remote(
+                                    ei,
+                                    *(done->handler),
+                                    *(done->target),
+                                    true);
+                        } else {
+                            add_once(ei, *(done->handler));
+                        }
+                        break;
+                    case ForeignCall::Kind::emit_batch:
+                        for (auto& batch_args : *(done->batch)) {
+                            ei.test_cast(batch_args);
+                        }
+                        // fallthrough
+                    case ForeignCall::Kind::emit_checked:
+                        ei.test_cast(done->args);
+                        // fallthrough
+                    case ForeignCall::Kind::signal:
+                    case ForeignCall::Kind::emit:
+                        // Producers do not wait, so deliver right away
+                        switch (queue_task(
+                                ei,
+                                (done->kind == ForeignCall::Kind::signal)
+                                        ? nullptr
+                                        : &(done->args),
+                                std::move(done->batch))) {
+                        case QueueResult::queued:
+                            dispatch(1);
+                            break;
+                        case QueueResult::skipped:
+                            break;
+                        case QueueResult::rejected:
+                            ensure_queued(ei, false);
+                            break;
+                        }
+                        break;
+                    }
+                }
+            }
+
+            using EventAllocator = PoolAllocator<EventInfo>;
+
+            EventEmitter& ee;
+            IAsyncTool& async_tool;
+            IMemPool& mem_pool;
+            const EventSchema* const schema;
+            SizeType max_listeners{8};
+            SizeType dispatch_batch{1};
+            SizeType scheduled{0};
+            SizeType max_pending{0};
+            OverflowPolicy overflow{OverflowPolicy::drop_newest};
+            QueueStats queue_stats;
+            bool lane_timing{false};
+            ListenerTiming listener_timing;
+            SizeType timing_countdown{0};
+            // Guards growth of events for snapshot
+            METRICS_ONLY(std::mutex metrics_mutex;)
+            std::deque<EventInfo, EventAllocator> events;
+            NameIndex event_names;
+            Lanes lanes;
+            ListenerSlots listener_slots;
+            AnyListeners any_listeners;
+            ListenerSize any_tombstones{0};
+            ListenerSize any_depth{0};
+            std::atomic<ForeignCall*> foreign_head{nullptr};
+            std::atomic_bool foreign_scheduled{false};
+            ForeignDrain foreign_drain{*this};
+            // Passed to local listeners of signals
+            NextArgs no_args;
+            std::shared_ptr<const NextArgs> shared_no_args;
+        };
+
+        constexpr std::size_t EventEmitter::PRIORITY_COUNT;
+        constexpr std::size_t EventEmitter::WAIT_BUCKETS;
+
+        EventEmitter::EventEmitter(IAsyncTool& async_tool) noexcept :
+            EventEmitter(async_tool, async_tool.mem_pool())
+        {}
+
+        EventEmitter::EventEmitter(
+                IAsyncTool& async_tool, IMemPool& mem_pool) noexcept :
+            async_tool_(async_tool),
+            mem_pool_(mem_pool),
+            schema_(nullptr)
+        {}
+
+        EventEmitter::EventEmitter(
+                IAsyncTool& async_tool, const EventSchema& schema) noexcept :
+            EventEmitter(async_tool, async_tool.mem_pool(), schema)
+        {}
+
+        EventEmitter::EventEmitter(
+                IAsyncTool& async_tool,
+                IMemPool& mem_pool,
+                const EventSchema& schema) noexcept :
+            async_tool_(async_tool),
+            mem_pool_(mem_pool),
+            schema_(&schema)
+        {}
+
+        EventEmitter::~EventEmitter() noexcept
+        {
+            auto impl = impl_.load();
+
+            if (impl != nullptr) {
+                impl->~Impl();
+                mem_pool_.deallocate(impl, sizeof(Impl), 1);
+            }
+        }
 
-                if (ei.listeners.empty() && ei.once.empty()) {
-                    return;
-                }
+        inline EventEmitter::Impl& EventEmitter::impl() noexcept
+        {
+            auto impl = impl_.load(std::memory_order_acquire);
 
-                assert(ei.pending != std::numeric_limits<ListenerSize>::max());
+            if (impl != nullptr) {
+                return *impl;
+            }
 
-                ++(ei.pending);
+            return create_impl();
+        }
 
-                tasks.emplace_back(ei, std::forward<NextArgs>(args));
-                async_tool.immediate(std::ref(*this));
+        EventEmitter::Impl& EventEmitter::create_impl() noexcept
+        {
+            // NOTE: memory pool is not safe to use from other threads
+            if (!async_tool_.is_same_thread()) {
+                std::promise<void> done;
+                auto f = [&]() {
+                    impl();
+                    done.set_value();
+                };
+
+                async_tool_.immediate(std::ref(f));
+                done.get_future().wait();
+                return *(impl_.load(std::memory_order_acquire));
             }
 
-            void operator()() noexcept
-            {
-                tasks.front()();
-                tasks.pop_front();
+            auto impl = new (mem_pool_.allocate(sizeof(Impl), 1))
+                    Impl(*this, async_tool_, mem_pool_, schema_);
+            impl_.store(impl, std::memory_order_release);
+            return *impl;
+        }
+
+        // Nobody can listen to schema events of emitter without state
+        bool EventEmitter::skip_idle(
+                const EventType& event, const NextArgs* args) noexcept
+        {
+            if ((schema_ == nullptr)
+                || (impl_.load(std::memory_order_acquire) != nullptr)) {
+                return false;
             }
 
-            IAsyncTool& async_tool;
-            SizeType max_listeners{8};
-            std::deque<EventInfo> events;
-            std::deque<EmitTask> tasks;
-        };
+            auto& schema_impl = *(schema_->impl_);
+            auto event_id = Accessor::event_id(event);
 
-        EventEmitter::EventEmitter(IAsyncTool& async_tool) noexcept :
-            impl_(new Impl(async_tool))
-        {}
+            if (event_id == NO_EVENT_ID) {
+                auto iter = schema_impl.names.find(
+                        Accessor::raw_event_type(event));
+
+                if (iter == schema_impl.names.end()) {
+                    return false;
+                }
+
+                event_id = iter->second;
+            } else if (Accessor::event_emitter(event) != schema_) {
+                return false;
+            }
+
+#ifndef NDEBUG
+            if (args != nullptr) {
+                schema_impl.entries[event_id - 1].test_cast(*args);
+            }
+#else
+            (void) args;
+#endif
 
-        EventEmitter::~EventEmitter() noexcept = default;
+            return true;
+        }
 
 #define ENSURE_IN_EVENT_LOOP(call_details)        \
-    if (!impl_->async_tool.is_same_thread()) {    \
+    if (!async_tool_.is_same_thread()) {          \
         std::promise<void> done;                  \
         auto f = [&, this]() {                    \
             this->call_details;                   \
             done.set_value();                     \
         };                                        \
                                                   \
-        impl_->async_tool.immediate(std::ref(f)); \
+        async_tool_.immediate(std::ref(f));       \
         done.get_future().wait();                 \
         return;                                   \
     }
 
+#define ENSURE_IN_EVENT_LOOP_RESULT(type, call_details)               \
+    if (!async_tool_.is_same_thread()) {                              \
+        std::promise<type> done;                                      \
+        auto f = [&, this]() { done.set_value(this->call_details); }; \
+                                                                      \
+        async_tool_.immediate(std::ref(f));                           \
+        return done.get_future().get();                               \
+    }
+
+#define POST_TO_EVENT_LOOP(kind, event, handler, ...)                          \
+    if (!async_tool_.is_same_thread()                                          \
+        && impl().post_foreign(                                                \
+                Impl::ForeignCall::Kind::kind, event, handler, __VA_ARGS__)) { \
+        return;                                                                \
+    }
+
         void EventEmitter::register_event_impl(
                 EventType& event,
                 TestCast test_cast,
@@ -224,17 +2156,37 @@ namespace futoin {
                 FatalMsg() << "Re-use of EventType object on registration";
             }
 
-            futoin::string name{Accessor::raw_event_type(event)};
-            auto& events = impl_->events;
+            const auto raw_name = Accessor::raw_event_type(event);
+            auto& event_names = impl().event_names;
 
-            for (auto& er : events) {
-                if (er.name == name) {
-                    FatalMsg() << "Double registration of event: " << name;
-                }
+            auto schema = impl().schema;
+
+            if ((event_names.find(raw_name) != event_names.end())
+                || ((schema != nullptr)
+                    && (schema->impl_->names.count(raw_name) != 0))) {
+                FatalMsg() << "Double registration of event: " << raw_name;
+            }
+
+            auto& events = impl().events;
+
+            // Own events go after schema ones
+            if (schema != nullptr) {
+                impl().materialize(schema->impl_->entries.size());
+            }
+
+            {
+                METRICS_ONLY(std::lock_guard<std::mutex> lock(
+                        impl().metrics_mutex);)
+                events.emplace_back(
+                        futoin::string{raw_name},
+                        events.size() + 1,
+                        test_cast,
+                        model_args,
+                        impl().mem_pool);
             }
 
-            events.emplace_back(
-                    std::move(name), events.size() + 1, test_cast, model_args);
+            auto& ei = events.back();
+            event_names.emplace(ei.name, &ei);
             Accessor::event_id(event) = events.size();
             Accessor::event_emitter(event) = this;
         }
@@ -242,112 +2194,540 @@ namespace futoin {
         void EventEmitter::setMaxListeners(
                 EventEmitter& ee, SizeType max_listeners) noexcept
         {
-            ee.impl_->max_listeners = max_listeners;
+            ee.impl().max_listeners = max_listeners;
         }
 
-        void EventEmitter::on(
-                const EventType& event, EventHandler& handler) noexcept
+        void EventEmitter::setDispatchBatch(
+                EventEmitter& ee, SizeType batch_size) noexcept
         {
-            ENSURE_IN_EVENT_LOOP(on(event, handler));
+            if (batch_size == 0) {
+                batch_size = std::numeric_limits<SizeType>::max();
+            }
 
-            auto& ei = impl_->process_new_handler(*this, event, handler);
-            auto& listeners = ei.listeners;
+            ee.impl().dispatch_batch = batch_size;
+        }
 
-            if (ei.pending == 0) {
-                for (auto& hp : listeners) {
-                    if (hp == nullptr) {
-                        hp = &handler;
-                        return;
-                    }
-                }
+        void EventEmitter::setLaneTiming(
+                EventEmitter& ee, bool enabled) noexcept
+        {
+            ee.impl().lane_timing = enabled;
+        }
+
+        void EventEmitter::setListenerTiming(
+                EventEmitter& ee, const ListenerTiming& timing) noexcept
+        {
+            ee.impl().listener_timing = timing;
+            ee.impl().timing_countdown = 0;
+        }
+
+        EventEmitter::EventTiming EventEmitter::getEventTiming(
+                const EventEmitter& ee, const EventType& event) noexcept
+        {
+            EventTiming res;
+            auto impl = ee.impl_.load();
+
+            if (impl == nullptr) {
+                return res;
+            }
+
+            auto& ei = impl->get_event_info(event);
+
+            if (ei.timing != nullptr) {
+                res.total = ei.timing->total;
+                res.listeners = ei.timing->listeners;
+            }
+
+            return res;
+        }
+
+        void EventEmitter::setMaxPending(
+                EventEmitter& ee,
+                SizeType max_pending,
+                OverflowPolicy overflow) noexcept
+        {
+            ee.impl().max_pending = max_pending;
+            ee.impl().overflow = overflow;
+        }
+
+        EventEmitter::QueueStats EventEmitter::getQueueStats(
+                const EventEmitter& ee) noexcept
+        {
+            auto impl = ee.impl_.load();
+            return (impl != nullptr) ? impl->queue_stats : QueueStats();
+        }
+
+        EventEmitter::MetricsSnapshot EventEmitter::getMetrics(
+                const EventEmitter& ee) noexcept
+        {
+            MetricsSnapshot res;
+
+#ifdef FUTOIN_EVENTEMITTER_METRICS
+            auto impl_ptr = ee.impl_.load();
+
+            if (impl_ptr == nullptr) {
+                return res;
             }
 
-            assert(listeners.size()
-                   != std::numeric_limits<Impl::ListenerSize>::max());
+            auto& impl = *impl_ptr;
+            std::lock_guard<std::mutex> lock(impl.metrics_mutex);
+
+            res.reserve(impl.events.size());
+
+            for (auto& ei : impl.events) {
+                auto& m = ei.metrics;
+                EventMetrics em;
+                em.name = ei.name;
+                em.emits = m.emits.get();
+                em.deliveries = m.deliveries.get();
+                em.once_deliveries = m.once_deliveries.get();
+                em.tombstones = m.tombstones.get();
+                em.peak_pending = m.peak_pending.get();
+
+                for (std::size_t i = 0; i < WAIT_BUCKETS; ++i) {
+                    em.wait_histogram[i] = m.wait_histogram[i].get();
+                }
 
-            if (listeners.size() == impl_->max_listeners) {
-                FatalMsgHook::stream()
-                        << "WARN: reached max event listeners: " << ei.name
-                        << std::endl;
+                res.push_back(em);
             }
+#else
+            (void) ee;
+#endif
+
+            return res;
+        }
+
+        EventEmitter::LaneStats EventEmitter::getLaneStats(
+                const EventEmitter& ee, Priority priority) noexcept
+        {
+            auto impl = ee.impl_.load();
+            return (impl != nullptr)
+                           ? impl->lanes[static_cast<std::size_t>(priority)]
+                                     .stats
+                           : LaneStats();
+        }
+
+        void EventEmitter::on(
+                const EventType& event, EventHandler& handler) noexcept
+        {
+            POST_TO_EVENT_LOOP(on, event, &handler, {});
+            ENSURE_IN_EVENT_LOOP(on(event, handler));
 
-            listeners.emplace_back(&handler);
+            auto& ei = impl().process_new_handler(event, handler);
+            impl().add_listener(ei, handler);
         }
 
         void EventEmitter::once(
                 const EventType& event, EventHandler& handler) noexcept
         {
+            POST_TO_EVENT_LOOP(once, event, &handler, {});
             ENSURE_IN_EVENT_LOOP(once(event, handler));
 
-            auto& ei = impl_->process_new_handler(*this, event, handler);
-            auto& once = ei.once;
+            auto& ei = impl().process_new_handler(event, handler);
+            impl().add_once(ei, handler);
+        }
+
+        void EventEmitter::on(
+                const EventType& event,
+                EventHandler& handler,
+                IAsyncTool& target) noexcept
+        {
+            POST_TO_EVENT_LOOP(on, event, &handler, {}, &target);
+            ENSURE_IN_EVENT_LOOP(on(event, handler, target));
+
+            auto& ei = impl().process_new_handler(event, handler);
+            impl().add_remote(ei, handler, target, false);
+        }
+
+        void EventEmitter::once(
+                const EventType& event,
+                EventHandler& handler,
+                IAsyncTool& target) noexcept
+        {
+            POST_TO_EVENT_LOOP(once, event, &handler, {}, &target);
+            ENSURE_IN_EVENT_LOOP(once(event, handler, target));
+
+            auto& ei = impl().process_new_handler(event, handler);
+            impl().add_remote(ei, handler, target, true);
+        }
+
+        void EventEmitter::on_any(AnyEventHandler& handler) noexcept
+        {
+            ENSURE_IN_EVENT_LOOP(on_any(handler));
+
+            impl().add_any(handler);
+        }
+
+        void EventEmitter::off_any(AnyEventHandler& handler) noexcept
+        {
+            ENSURE_IN_EVENT_LOOP(off_any(handler));
+
+            if (!impl().remove_any(handler)) {
+                FatalMsg() << "Not registered handler!";
+            }
+        }
+
+        void EventEmitter::forward(
+                const EventType& event,
+                EventEmitter& target,
+                const EventType& target_event) noexcept
+        {
+            ENSURE_IN_EVENT_LOOP(forward(event, target, target_event));
+
+            if (&(target.async_tool_) != &async_tool_) {
+                FatalMsg() << "forward() to emitter of other event loop";
+            }
 
-            assert(once.size()
-                   != std::numeric_limits<Impl::ListenerSize>::max());
+            auto& ei = impl().get_event_info(event);
+            auto& target_ei = target.impl().get_event_info(target_event);
 
-            if (once.size() == impl_->max_listeners) {
-                FatalMsgHook::stream()
-                        << "WARN: reached max event once listeners: " << ei.name
-                        << std::endl;
+            if (&target_ei == &ei) {
+                FatalMsg() << "forward() of event to itself: " << ei.name;
             }
 
-            once.emplace_back(&handler);
-            ++(ei.once_next);
+            // Once per binding instead of every emit
+            target_ei.test_cast(*(ei.model_args));
+
+            impl().add_forward(ei, target.impl(), target_ei);
+        }
+
+        void EventEmitter::unforward(
+                const EventType& event,
+                EventEmitter& target,
+                const EventType& target_event) noexcept
+        {
+            ENSURE_IN_EVENT_LOOP(unforward(event, target, target_event));
+
+            auto& ei = impl().get_event_info(event);
+            auto& target_ei = target.impl().get_event_info(target_event);
+
+            if (!impl().remove_forward(ei, target.impl(), target_ei)) {
+                FatalMsg() << "Not registered forward!";
+            }
         }
 
         void EventEmitter::off(
                 const EventType& event, EventHandler& handler) noexcept
         {
-            ENSURE_IN_EVENT_LOOP(off(event, handler));
-
-            auto& ei = impl_->get_event_info(*this, event);
+            Impl::RemoteListener* detached = nullptr;
+            const bool in_loop = async_tool_.is_same_thread();
 
-            bool found = false;
-            auto& listeners = ei.listeners;
+            auto remove = [&, this]() {
+                auto& ei = impl().get_event_info(event);
 
-            for (auto& hp : listeners) {
-                if (hp == &handler) {
-                    found = true;
-                    hp = nullptr;
-                    break;
+                if (impl().remove_listener(ei, handler, detached)) {
+                    Accessor::event_id(handler) = NO_EVENT_ID;
+                } else {
+                    FatalMsg() << "Not registered handler!";
                 }
-            }
+            };
 
-            if (!found) {
-                auto& once = ei.once;
+            if (in_loop) {
+                remove();
+            } else {
+                std::promise<void> done;
+                auto f = [&]() {
+                    remove();
+                    done.set_value();
+                };
+
+                async_tool_.immediate(std::ref(f));
+                done.get_future().wait();
+            }
 
-                for (auto& hp : once) {
-                    if (hp == &handler) {
-                        found = true;
-                        hp = nullptr;
-                        break;
-                    }
+            // NOTE: event loop must never block on a running remote call
+            if (detached != nullptr) {
+                if (!in_loop) {
+                    detached->wait_idle();
                 }
-            }
 
-            if (found) {
-                Accessor::event_id(handler) = NO_EVENT_ID;
-            } else {
-                FatalMsg() << "Not registered handler!";
+                detached->release();
             }
         }
 
         void EventEmitter::emit(const EventType& event) noexcept
         {
+            if (skip_idle(event)) {
+                return;
+            }
+
+            POST_TO_EVENT_LOOP(signal, event, nullptr, {});
             ENSURE_IN_EVENT_LOOP(emit(event));
 
-            auto& ei = impl_->get_event_info(*this, event);
-            impl_->call_listeners(ei);
+            auto& ei = impl().get_event_info(event);
+            impl().ensure_queued(ei, impl().call_listeners(ei));
         }
 
         void EventEmitter::emit(
                 const EventType& event, NextArgs&& args) noexcept
         {
+            if (skip_idle(event, &args)) {
+                return;
+            }
+
+            POST_TO_EVENT_LOOP(
+                    emit_checked, event, nullptr, std::forward<NextArgs>(args));
             ENSURE_IN_EVENT_LOOP(emit(event, std::forward<NextArgs>(args)));
 
-            auto& ei = impl_->get_event_info(*this, event);
+            auto& ei = impl().get_event_info(event);
+
+#ifdef NDEBUG
+            if (impl().skip_unobserved(ei)) {
+                return;
+            }
+#endif
+
+            ei.test_cast(args);
+            impl().ensure_queued(
+                    ei,
+                    impl().call_listeners(ei, &args));
+        }
+
+        void EventEmitter::emit_lazy_impl(
+                const EventType& event,
+                ArgsFactory factory,
+                void* factory_ctx) noexcept
+        {
+            if (skip_idle(event)) {
+                return;
+            }
+
+            if (!async_tool_.is_same_thread()) {
+                // NOTE: listeners can be checked only in event loop
+                emit(event, factory(factory_ctx));
+                return;
+            }
+
+            auto& ei = impl().get_event_info(event);
+
+            if (impl().skip_unobserved(ei)) {
+                return;
+            }
+
+            auto args = factory(factory_ctx);
+            ei.test_cast(args);
+            impl().ensure_queued(
+                    ei, impl().call_listeners(ei, &args));
+        }
+
+        void EventEmitter::emit_batch(
+                const EventType& event, ArgsBatch&& batch) noexcept
+        {
+            if (batch.empty() || skip_idle(event, &(batch.back()))) {
+                return;
+            }
+
+            // Name lookup is not safe outside of event loop thread
+            if (Accessor::event_id(event) == NO_EVENT_ID) {
+                ENSURE_IN_EVENT_LOOP(emit_batch(event, std::move(batch)));
+            }
+
+            // Last pack goes as regular args, so coalescing keeps it
+            auto args = std::move(batch.back());
+            batch.pop_back();
+
+            Impl::Batch rest;
+
+            if (!batch.empty()) {
+                rest.reset(new ArgsBatch(std::move(batch)));
+            }
+
+            if (!async_tool_.is_same_thread()) {
+                if (!impl().post_foreign(
+                            Impl::ForeignCall::Kind::emit_batch,
+                            event,
+                            nullptr,
+                            std::move(args),
+                            nullptr,
+                            std::move(rest))) {
+                    FatalMsg() << "foreign event type!";
+                }
+
+                return;
+            }
+
+            auto& ei = impl().get_event_info(event);
+
+            if (rest != nullptr) {
+                for (auto& batch_args : *rest) {
+                    ei.test_cast(batch_args);
+                }
+            }
+
+            ei.test_cast(args);
+            impl().ensure_queued(
+                    ei,
+                    impl().call_listeners(ei, &args, std::move(rest)));
+        }
+
+        bool EventEmitter::has_listeners(const EventType& event) noexcept
+        {
+            return listener_count(event) != 0;
+        }
+
+        std::size_t EventEmitter::listener_count(
+                const EventType& event) noexcept
+        {
+            if (skip_idle(event)) {
+                return 0;
+            }
+
+            ENSURE_IN_EVENT_LOOP_RESULT(std::size_t, listener_count(event));
+
+            return impl().listener_count(impl().get_event_info(event));
+        }
+
+        bool EventEmitter::try_emit(const EventType& event) noexcept
+        {
+            if (skip_idle(event)) {
+                return true;
+            }
+
+            ENSURE_IN_EVENT_LOOP_RESULT(bool, try_emit(event));
+
+            auto& ei = impl().get_event_info(event);
+            return impl().call_listeners(ei);
+        }
+
+        bool EventEmitter::try_emit(
+                const EventType& event, NextArgs&& args) noexcept
+        {
+            if (skip_idle(event, &args)) {
+                return true;
+            }
+
+            ENSURE_IN_EVENT_LOOP_RESULT(
+                    bool, try_emit(event, std::forward<NextArgs>(args)));
+
+            auto& ei = impl().get_event_info(event);
+            ei.test_cast(args);
+            return impl().call_listeners(ei, &args);
+        }
+
+        void EventEmitter::emit_now(const EventType& event) noexcept
+        {
+            if (skip_idle(event)) {
+                return;
+            }
+
+            ENSURE_IN_EVENT_LOOP(emit_now(event));
+
+            auto& ei = impl().get_event_info(event);
+            impl().ensure_queued(ei, impl().call_listeners_now(ei));
+        }
+
+        void EventEmitter::emit_now(
+                const EventType& event, NextArgs&& args) noexcept
+        {
+            if (skip_idle(event, &args)) {
+                return;
+            }
+
+            ENSURE_IN_EVENT_LOOP(emit_now(event, std::forward<NextArgs>(args)));
+
+            auto& ei = impl().get_event_info(event);
+            ei.test_cast(args);
+            impl().ensure_queued(
+                    ei,
+                    impl().call_listeners_now(ei, &args));
+        }
+
+        void EventEmitter::set_event_options(
+                const EventType& event, const EventOptions& options) noexcept
+        {
+            ENSURE_IN_EVENT_LOOP(set_event_options(event, options));
+
+            auto& ei = impl().get_event_info(event);
+
+            if (ei.pending != 0) {
+                FatalMsg() << "event options change with pending emits: "
+                           << ei.name;
+            }
+
+            impl().apply_options(ei, options);
+        }
+
+        void EventEmitter::emit_typed(
+                const EventType& event, NextArgs&& args) noexcept
+        {
+            if (skip_idle(event, &args)) {
+                return;
+            }
+
+            POST_TO_EVENT_LOOP(
+                    emit, event, nullptr, std::forward<NextArgs>(args));
+            ENSURE_IN_EVENT_LOOP(
+                    emit_typed(event, std::forward<NextArgs>(args)));
+
+            auto& ei = impl().get_event_info(event);
+#ifndef NDEBUG
             ei.test_cast(args);
-            impl_->call_listeners(ei, std::forward<NextArgs>(args));
+#endif
+            impl().ensure_queued(
+                    ei,
+                    impl().call_listeners(ei, &args));
+        }
+
+        //---
+        EventSchema::EventSchema() noexcept : impl_(new Impl) {}
+
+        EventSchema::~EventSchema() noexcept = default;
+
+        void EventSchema::register_event_impl(
+                EventType& event,
+                TestCast test_cast,
+                const NextArgs& model_args) noexcept
+        {
+            if (Accessor::event_id(event) != 0) {
+                FatalMsg() << "Re-use of EventType object on registration";
+            }
+
+            const auto raw_name = Accessor::raw_event_type(event);
+            auto& entries = impl_->entries;
+
+            if (impl_->names.count(raw_name) != 0) {
+                FatalMsg() << "Double registration of event: " << raw_name;
+            }
+
+            entries.emplace_back(raw_name, test_cast, model_args);
+            impl_->names.emplace(entries.back().name.c_str(), entries.size());
+            Accessor::event_id(event) = entries.size();
+            Accessor::event_emitter(event) = this;
+        }
+
+        void EventSchema::set_event_options(
+                const EventType& event, const EventOptions& options) noexcept
+        {
+            impl_->entries[Accessor::event_id(event) - 1].options = options;
+        }
+
+        std::size_t EventSchema::size() const noexcept
+        {
+            return impl_->entries.size();
+        }
+
+        void EventSchema::on(const EventType&, EventHandler&) noexcept
+        {
+            FatalMsg() << "EventSchema is not an emitter";
+        }
+
+        void EventSchema::once(const EventType&, EventHandler&) noexcept
+        {
+            FatalMsg() << "EventSchema is not an emitter";
+        }
+
+        void EventSchema::off(const EventType&, EventHandler&) noexcept
+        {
+            FatalMsg() << "EventSchema is not an emitter";
+        }
+
+        void EventSchema::emit(const EventType&) noexcept
+        {
+            FatalMsg() << "EventSchema is not an emitter";
+        }
+
+        void EventSchema::emit(const EventType&, NextArgs&&) noexcept
+        {
+            FatalMsg() << "EventSchema is not an emitter";
         }
     } // namespace ri
 } // namespace futoin
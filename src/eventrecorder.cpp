@@ -0,0 +1,398 @@
+//-----------------------------------------------------------------------------
+//   Copyright 2018 FutoIn Project
+//   Copyright 2018 Andrey Galkin
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//-----------------------------------------------------------------------------
+
+#include <futoin/fatalmsg.hpp>
+#include <futoin/ri/eventrecorder.hpp>
+//---
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+//---
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Trace file layout:
+//  header: MAGIC
+//  record: varint((channel << 1) | DEFINE), varint(size), name
+//  record: varint(channel << 1), varint(time delta ns), varint(size), args
+
+namespace futoin {
+    namespace ri {
+        namespace {
+            constexpr char MAGIC[8] = {'F', 'T', 'N', 'E', 'V', 'T', '0', '1'};
+            constexpr std::uint64_t DEFINE = 1;
+            constexpr std::size_t MIN_MAP_SIZE = 1U << 20U;
+
+            using Clock = std::chrono::steady_clock;
+
+            std::size_t encode_varint(
+                    std::uint8_t* out, std::uint64_t value) noexcept
+            {
+                std::size_t len = 0;
+
+                for (; value >= 0x80U; value >>= 7U) {
+                    out[len++] = static_cast<std::uint8_t>(value | 0x80U);
+                }
+
+                out[len++] = static_cast<std::uint8_t>(value);
+                return len;
+            }
+        } // namespace
+
+        void TraceOutput::write_varint(std::uint64_t value) noexcept
+        {
+            std::uint8_t buf[10];
+            write(buf, encode_varint(buf, value));
+        }
+
+        const std::uint8_t* TraceInput::read(std::uint64_t size) noexcept
+        {
+            if (std::uint64_t(end_ - pos_) < size) {
+                FatalMsg() << "corrupted event trace";
+            }
+
+            auto res = pos_;
+            pos_ += std::size_t(size);
+            return res;
+        }
+
+        const std::uint8_t* TraceInput::read(
+                std::uint64_t count, std::size_t item_size) noexcept
+        {
+            // NOTE: no multiplication of untrusted count before the check
+            if ((std::uint64_t(end_ - pos_) / item_size) < count) {
+                FatalMsg() << "corrupted event trace";
+            }
+
+            return read(count * item_size);
+        }
+
+        std::uint64_t TraceInput::read_varint() noexcept
+        {
+            std::uint64_t res = 0;
+
+            for (unsigned shift = 0; shift < 64; shift += 7) {
+                const auto b = *read(1);
+                res |= std::uint64_t(b & 0x7FU) << shift;
+
+                if ((b & 0x80U) == 0) {
+                    return res;
+                }
+            }
+
+            FatalMsg() << "corrupted event trace";
+        }
+
+        //---
+        struct EventRecorder::Impl
+        {
+            Impl(const char* path) noexcept
+            {
+                fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+                if (fd < 0) {
+                    FatalMsg() << "failed to create event trace: " << path;
+                }
+
+                append(MAGIC, sizeof(MAGIC));
+            }
+
+            ~Impl() noexcept
+            {
+                if (map != nullptr) {
+                    ::munmap(map, capacity);
+                }
+
+                // Drop preallocated tail
+                if (::ftruncate(fd, used) != 0) {
+                    FatalMsgHook::stream()
+                            << "WARN: failed to truncate event trace"
+                            << std::endl;
+                }
+
+                ::close(fd);
+            }
+
+            void reserve(std::size_t size) noexcept
+            {
+                if ((used + size) <= capacity) {
+                    return;
+                }
+
+                auto new_capacity = std::max(capacity * 2U, MIN_MAP_SIZE);
+
+                while (new_capacity < (used + size)) {
+                    new_capacity *= 2U;
+                }
+
+                if (map != nullptr) {
+                    ::munmap(map, capacity);
+                    map = nullptr;
+                }
+
+                if (::ftruncate(fd, new_capacity) != 0) {
+                    FatalMsg() << "failed to grow event trace";
+                }
+
+                auto p = ::mmap(
+                        nullptr,
+                        new_capacity,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED,
+                        fd,
+                        0);
+
+                if (p == MAP_FAILED) {
+                    FatalMsg() << "failed to map event trace";
+                }
+
+                map = static_cast<std::uint8_t*>(p);
+                capacity = new_capacity;
+            }
+
+            void append(const void* data, std::size_t size) noexcept
+            {
+                reserve(size);
+                std::memcpy(map + used, data, size);
+                used += size;
+            }
+
+            void append_varint(std::uint64_t value) noexcept
+            {
+                reserve(10);
+                used += encode_varint(map + used, value);
+            }
+
+            int fd{-1};
+            std::uint8_t* map{nullptr};
+            std::size_t capacity{0};
+            std::size_t used{0};
+            std::size_t records{0};
+            std::uint64_t last_ts{0};
+            const Clock::time_point start{Clock::now()};
+            // NOTE: emitters may run in different threads
+            std::mutex mutex;
+            TraceOutput out;
+        };
+
+        EventRecorder::EventRecorder(const char* path) noexcept :
+            impl_(new Impl(path))
+        {}
+
+        EventRecorder::~EventRecorder() noexcept
+        {
+            for (auto& c : channels_) {
+                c.ee.off(c.event, c.handler);
+            }
+        }
+
+        EventRecorder::Channel& EventRecorder::add_channel(
+                IEventEmitter& ee,
+                const EventType& event,
+                const char* name) noexcept
+        {
+            std::lock_guard<std::mutex> lock(impl_->mutex);
+
+            const auto id = channels_.size();
+            channels_.emplace_back(ee, event, id);
+
+            const auto name_len = std::strlen(name);
+            impl_->append_varint((id << 1U) | DEFINE);
+            impl_->append_varint(name_len);
+            impl_->append(name, name_len);
+
+            return channels_.back();
+        }
+
+        TraceOutput& EventRecorder::begin_record() noexcept
+        {
+            // NOTE: released in commit_record()
+            impl_->mutex.lock();
+
+            auto& out = impl_->out;
+            out.buffer_.clear();
+            return out;
+        }
+
+        void EventRecorder::commit_record(std::uint64_t channel) noexcept
+        {
+            auto& impl = *impl_;
+            auto& payload = impl.out.buffer_;
+
+            const std::uint64_t ts =
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            Clock::now() - impl.start)
+                            .count();
+
+            impl.append_varint(channel << 1U);
+            impl.append_varint(ts - impl.last_ts);
+            impl.append_varint(payload.size());
+            impl.append(payload.data(), payload.size());
+
+            impl.last_ts = ts;
+            ++(impl.records);
+
+            impl.mutex.unlock();
+        }
+
+        std::size_t EventRecorder::size() const noexcept
+        {
+            std::lock_guard<std::mutex> lock(impl_->mutex);
+            return impl_->records;
+        }
+
+        //---
+        struct EventReplay::Impl
+        {
+            struct Binding
+            {
+                IEventEmitter* ee;
+                const EventType* event;
+                Decoder decoder;
+            };
+
+            Impl(const char* path) noexcept
+            {
+                fd = ::open(path, O_RDONLY);
+
+                if (fd < 0) {
+                    FatalMsg() << "failed to open event trace: " << path;
+                }
+
+                struct stat st;
+
+                if (::fstat(fd, &st) != 0) {
+                    FatalMsg() << "failed to stat event trace: " << path;
+                }
+
+                size = st.st_size;
+
+                if (size < sizeof(MAGIC)) {
+                    FatalMsg() << "not an event trace: " << path;
+                }
+
+                auto p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+                if (p == MAP_FAILED) {
+                    FatalMsg() << "failed to map event trace: " << path;
+                }
+
+                map = static_cast<const std::uint8_t*>(p);
+
+                if (std::memcmp(map, MAGIC, sizeof(MAGIC)) != 0) {
+                    FatalMsg() << "not an event trace: " << path;
+                }
+            }
+
+            ~Impl() noexcept
+            {
+                ::munmap(const_cast<std::uint8_t*>(map), size);
+                ::close(fd);
+            }
+
+            int fd{-1};
+            const std::uint8_t* map{nullptr};
+            std::size_t size{0};
+            std::unordered_map<std::string, Binding> bindings;
+        };
+
+        EventReplay::EventReplay(const char* path) noexcept :
+            impl_(new Impl(path))
+        {}
+
+        EventReplay::~EventReplay() noexcept = default;
+
+        void EventReplay::add_binding(
+                const char* name,
+                IEventEmitter& ee,
+                const EventType& event,
+                Decoder decoder) noexcept
+        {
+            impl_->bindings[name] = Impl::Binding{&ee, &event, decoder};
+        }
+
+        std::size_t EventReplay::run(bool original_speed) noexcept
+        {
+            auto& impl = *impl_;
+            std::vector<const Impl::Binding*> channels;
+            TraceInput in(impl.map + sizeof(MAGIC), impl.map + impl.size);
+            std::uint64_t ts = 0;
+            std::size_t count = 0;
+            const auto start = Clock::now();
+
+            while (!in.empty()) {
+                const auto tag = in.read_varint();
+                const auto channel = tag >> 1U;
+
+                if ((tag & DEFINE) != 0) {
+                    const auto name_len = in.read_varint();
+                    const auto name = reinterpret_cast<const char*>(
+                            in.read(name_len));
+                    auto iter = impl.bindings.find(
+                            std::string(name, std::size_t(name_len)));
+
+                    // Recorder defines channels in sequence
+                    if (channel > channels.size()) {
+                        FatalMsg() << "corrupted event trace";
+                    }
+
+                    if (channel == channels.size()) {
+                        channels.push_back(nullptr);
+                    }
+
+                    channels[channel] = (iter != impl.bindings.end())
+                                                ? &(iter->second)
+                                                : nullptr;
+                    continue;
+                }
+
+                ts += in.read_varint();
+                const auto payload_size = in.read_varint();
+                const auto payload = in.read(payload_size);
+
+                if ((channel >= channels.size())
+                    || (channels[channel] == nullptr)) {
+                    continue;
+                }
+
+                if (original_speed) {
+                    std::this_thread::sleep_until(
+                            start + std::chrono::nanoseconds(ts));
+                }
+
+                auto& b = *(channels[channel]);
+                TraceInput args_in(payload, payload + payload_size);
+                auto args = b.decoder(args_in);
+
+                // Decoder must consume exactly the recorded payload
+                if (!args_in.empty()) {
+                    FatalMsg() << "corrupted event trace";
+                }
+
+                b.ee->emit(*(b.event), std::move(args));
+                ++count;
+            }
+
+            return count;
+        }
+    } // namespace ri
+} // namespace futoin
@@ -0,0 +1,227 @@
+//-----------------------------------------------------------------------------
+//   Copyright 2018 FutoIn Project
+//   Copyright 2018 Andrey Galkin
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//-----------------------------------------------------------------------------
+
+#include <boost/test/unit_test.hpp>
+//---
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <vector>
+//---
+#include <futoin/ri/concurrenteventemitter.hpp>
+
+BOOST_AUTO_TEST_SUITE(concurrenteventemitter) // NOLINT
+
+namespace {
+    struct TestEventEmitter : futoin::ri::ConcurrentEventEmitter
+    {
+        using ConcurrentEventEmitter::register_event;
+    };
+} // namespace
+
+BOOST_AUTO_TEST_CASE(basic) // NOLINT
+{
+    TestEventEmitter tee;
+    futoin::IEventEmitter& ee = tee;
+
+    futoin::IEventEmitter::EventType test_event("TestEvent");
+    tee.register_event<int>(test_event);
+
+    int sum = 0;
+    int once_sum = 0;
+    futoin::IEventEmitter::EventHandler handler([&](int a) { sum += a; });
+    futoin::IEventEmitter::EventHandler once_handler(
+            [&](int a) { once_sum += a; });
+
+    ee.emit(test_event, 1);
+    ee.on(test_event, handler);
+    ee.once(test_event, once_handler);
+
+    // Listeners run before return
+    ee.emit(test_event, 2);
+    BOOST_CHECK_EQUAL(sum, 2);
+    BOOST_CHECK_EQUAL(once_sum, 2);
+
+    ee.emit("TestEvent", 3);
+    BOOST_CHECK_EQUAL(sum, 5);
+    BOOST_CHECK_EQUAL(once_sum, 2);
+
+    // Once handler can be re-used after it fired
+    ee.once(test_event, once_handler);
+    ee.off(test_event, once_handler);
+    ee.off(test_event, handler);
+
+    ee.emit(test_event, 4);
+    BOOST_CHECK_EQUAL(sum, 5);
+    BOOST_CHECK_EQUAL(once_sum, 2);
+}
+
+BOOST_AUTO_TEST_CASE(off_in_listener) // NOLINT
+{
+    TestEventEmitter tee;
+    futoin::IEventEmitter& ee = tee;
+
+    futoin::IEventEmitter::EventType test_event("TestEvent");
+    tee.register_event(test_event);
+
+    int count = 0;
+    futoin::IEventEmitter::EventHandler handler;
+    handler = [&]() {
+        ++count;
+        ee.off(test_event, handler);
+    };
+
+    ee.on(test_event, handler);
+    ee.emit(test_event);
+    ee.emit(test_event);
+    BOOST_CHECK_EQUAL(count, 1);
+}
+
+BOOST_AUTO_TEST_CASE(threads) // NOLINT
+{
+    const std::size_t THREADS = 4;
+    const std::size_t EMITS = 20000;
+    const std::size_t CHURN = 500;
+
+    TestEventEmitter tee;
+    futoin::IEventEmitter& ee = tee;
+
+    futoin::IEventEmitter::EventType test_event("TestEvent");
+    tee.register_event<int>(test_event);
+
+    std::atomic<std::size_t> count{0};
+    std::atomic<std::size_t> once_count{0};
+    futoin::IEventEmitter::EventHandler handler(
+            [&](int) { count.fetch_add(1); });
+    ee.on(test_event, handler);
+
+    std::vector<std::thread> threads;
+    std::vector<std::deque<futoin::IEventEmitter::EventHandler>> once_handlers(
+            THREADS);
+
+    for (std::size_t t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&]() {
+            for (std::size_t i = 0; i < EMITS; ++i) {
+                ee.emit(test_event, int(i));
+            }
+        });
+    }
+
+    // Subscribers come and go while others emit
+    for (std::size_t t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&, t]() {
+            auto& handlers = once_handlers[t];
+
+            for (std::size_t i = 0; i < CHURN; ++i) {
+                handlers.emplace_back([&](int) { once_count.fetch_add(1); });
+                ee.once(test_event, handlers.back());
+
+                futoin::IEventEmitter::EventHandler temp([](int) {});
+                ee.on(test_event, temp);
+                ee.off(test_event, temp);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    // Fire the rest of once listeners
+    ee.emit(test_event, 0);
+
+    BOOST_CHECK_EQUAL(count.load(), THREADS * EMITS + 1);
+    BOOST_CHECK_EQUAL(once_count.load(), THREADS * CHURN);
+
+    ee.off(test_event, handler);
+}
+
+BOOST_AUTO_TEST_CASE(off_races) // NOLINT
+{
+    const std::size_t THREADS = 4;
+    const std::size_t ROUNDS = 2000;
+
+    TestEventEmitter tee;
+    futoin::IEventEmitter& ee = tee;
+    TestEventEmitter other;
+    futoin::IEventEmitter& other_ee = other;
+
+    futoin::IEventEmitter::EventType test_event("TestEvent");
+    tee.register_event(test_event);
+    futoin::IEventEmitter::EventType other_event("OtherEvent");
+    other.register_event(other_event);
+
+    std::atomic_bool stop{false};
+    std::vector<std::thread> threads;
+
+    for (std::size_t t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&]() {
+            while (!stop.load()) {
+                ee.emit(test_event);
+            }
+        });
+    }
+
+    // off() may race with concurrent fire of once handler
+    for (std::size_t t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&]() {
+            futoin::IEventEmitter::EventHandler once_handler([]() {});
+            futoin::IEventEmitter::EventHandler handler([]() {});
+
+            for (std::size_t i = 0; i < ROUNDS; ++i) {
+                ee.once(test_event, once_handler);
+                ee.on(test_event, handler);
+                ee.off(test_event, once_handler);
+                ee.off(test_event, handler);
+            }
+        });
+    }
+
+    // off() from listener of other emitter still waits
+    std::atomic_bool running{false};
+    futoin::IEventEmitter::EventHandler slow_handler([&]() {
+        running.store(true);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        running.store(false);
+    });
+    futoin::IEventEmitter::EventHandler off_handler([&]() {
+        ee.off(test_event, slow_handler);
+        BOOST_CHECK(!running.load());
+    });
+    other_ee.on(other_event, off_handler);
+
+    for (std::size_t i = 0; i < ROUNDS / 10; ++i) {
+        ee.on(test_event, slow_handler);
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        other_ee.emit(other_event);
+    }
+
+    for (std::size_t t = THREADS; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+
+    stop.store(true);
+
+    for (std::size_t t = 0; t < THREADS; ++t) {
+        threads[t].join();
+    }
+
+    other_ee.off(other_event, off_handler);
+}
+
+BOOST_AUTO_TEST_SUITE_END() // NOLINT
@@ -17,20 +17,68 @@
 
 #include <boost/test/unit_test.hpp>
 //---
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <deque>
 #include <future>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
 //---
 #include <futoin/ri/asynctool.hpp>
 #include <futoin/ri/eventemitter.hpp>
+//---
+#include "heapcounter.hpp"
 
 BOOST_AUTO_TEST_SUITE(eventemitter) // NOLINT
 
 struct TestEventEmitter : futoin::ri::EventEmitter
 {
     TestEventEmitter(futoin::ri::AsyncTool& at) : EventEmitter(at) {}
+    TestEventEmitter(futoin::ri::AsyncTool& at, futoin::IMemPool& mem_pool) :
+        EventEmitter(at, mem_pool)
+    {}
+    TestEventEmitter(
+            futoin::ri::AsyncTool& at,
+            const futoin::ri::EventSchema& schema) :
+        EventEmitter(at, schema)
+    {}
+    TestEventEmitter(
+            futoin::ri::AsyncTool& at,
+            futoin::IMemPool& mem_pool,
+            const futoin::ri::EventSchema& schema) :
+        EventEmitter(at, mem_pool, schema)
+    {}
 
     using EventEmitter::register_event;
+    using EventEmitter::set_event_options;
+};
+
+struct CountingMemPool : futoin::IMemPool
+{
+    void* allocate(std::size_t object_size, std::size_t count) noexcept override
+    {
+        ++allocated;
+        return ::operator new(object_size * count);
+    }
+
+    void deallocate(
+            void* ptr,
+            std::size_t /*object_size*/,
+            std::size_t /*count*/) noexcept override
+    {
+        ++deallocated;
+        ::operator delete(ptr);
+    }
+
+    void release_memory() noexcept override {}
+
+    // NOTE: remote calls release memory in target thread
+    std::atomic<std::size_t> allocated{0};
+    std::atomic<std::size_t> deallocated{0};
 };
 
 futoin::ri::AsyncTool at;
@@ -42,6 +90,13 @@ void wait_at_halt()
     done.get_future().wait();
 }
 
+// Emits of a task get dispatched by tasks scheduled after it
+void wait_dispatched()
+{
+    wait_at_halt();
+    wait_at_halt();
+}
+
 BOOST_AUTO_TEST_CASE(instance) // NOLINT
 {
     TestEventEmitter tee{at};
@@ -94,6 +149,74 @@ BOOST_AUTO_TEST_CASE(emit) // NOLINT
     wait_at_halt();
 }
 
+BOOST_AUTO_TEST_CASE(signal) // NOLINT
+{
+    CountingMemPool mem_pool;
+    TestEventEmitter tee{at, mem_pool};
+    futoin::IEventEmitter& ee = tee;
+
+    TestEventEmitter::EventType signal_event("SignalEvent");
+    TestEventEmitter::EventType data_event("DataEvent");
+    tee.register_event(signal_event);
+    tee.register_event<int>(data_event);
+
+    // NOTE: reserved to keep listeners off the heap
+    std::vector<int> seen;
+    seen.reserve(101 * 200);
+
+    TestEventEmitter::EventHandler signal_handler(
+            [&]() { seen.push_back(-1); });
+    TestEventEmitter::EventHandler data_handler(
+            [&](int v) { seen.push_back(v); });
+    ee.on(signal_event, signal_handler);
+    ee.on(data_event, data_handler);
+
+    // Signals get queued behind pending emits with arguments
+    auto emit_batch = [&]() {
+        for (auto i = 0; i < 100; ++i) {
+            ee.emit(data_event, i);
+            ee.emit(signal_event);
+        }
+    };
+    auto run_batch = [&]() {
+        at.immediate(std::ref(emit_batch));
+        wait_dispatched();
+    };
+
+    // Warm up
+    run_batch();
+
+    const auto warm_allocated = mem_pool.allocated.load();
+    test::heap_allocations = 0;
+
+    // NOTE: only the event loop thread is counted
+    at.immediate([]() { test::count_heap = true; });
+
+    for (auto i = 0; i < 100; ++i) {
+        run_batch();
+    }
+
+    at.immediate([]() { test::count_heap = false; });
+    wait_at_halt();
+
+    BOOST_CHECK_EQUAL(mem_pool.allocated.load(), warm_allocated);
+    BOOST_CHECK_EQUAL(test::heap_allocations.load(), 0U);
+
+    std::vector<int> expected;
+
+    for (auto b = 0; b < 101; ++b) {
+        for (auto i = 0; i < 100; ++i) {
+            expected.push_back(i);
+            expected.push_back(-1);
+        }
+    }
+
+    BOOST_CHECK(seen == expected);
+
+    ee.off(signal_event, signal_handler);
+    ee.off(data_event, data_handler);
+}
+
 BOOST_AUTO_TEST_CASE(with_args) // NOLINT
 {
     TestEventEmitter tee{at};
@@ -178,218 +301,1940 @@ BOOST_AUTO_TEST_CASE(with_args) // NOLINT
     BOOST_CHECK_EQUAL(count.load(), 8U);
 }
 
-BOOST_AUTO_TEST_CASE(multiple) // NOLINT
+BOOST_AUTO_TEST_CASE(typed) // NOLINT
 {
     TestEventEmitter tee{at};
-    futoin::IEventEmitter& ee = tee;
     std::atomic_size_t count{0};
-    const size_t HCOUNT = 10;
-
-    futoin::IEventEmitter::EventType test_event{"TestEvent"};
-    tee.register_event<int, futoin::string>(test_event);
-
-    auto handler = [&](int a) {
-        BOOST_CHECK_EQUAL(a, 123);
-        ++count;
-    };
 
-    std::deque<futoin::IEventEmitter::EventHandler> handlers;
+    TestEventEmitter::TypedEventType<> test_event1("TestEvent1");
+    tee.register_event(test_event1);
 
-    for (auto i = HCOUNT; i > 0; --i) {
-        handlers.emplace_back(std::ref(handler));
-        ee.on("TestEvent", handlers.back());
+    TestEventEmitter::TypedEventHandler<> handler1([&]() { ++count; });
+    tee.on(test_event1, handler1);
+    tee.emit(test_event1);
 
-        handlers.emplace_back(std::ref(handler));
-        ee.on("TestEvent", handlers.back());
+    TestEventEmitter::TypedEventType<int, futoin::string> test_event2(
+            "TestEvent2");
+    tee.register_event(test_event2);
 
-        handlers.emplace_back(std::ref(handler));
-        ee.once(test_event, handlers.back());
+    TestEventEmitter::TypedEventHandler<int, futoin::string> handler2(
+            [&](int a, const futoin::string& b) {
+                BOOST_CHECK_EQUAL(a, 123);
+                BOOST_CHECK_EQUAL(b, "str");
+                ++count;
+            });
+    tee.on(test_event2, handler2);
+    tee.emit(test_event2, 123, "str");
 
-        handlers.emplace_back(std::ref(handler));
-        ee.once(test_event, handlers.back());
+    TestEventEmitter::TypedEventHandler<int, futoin::string> handler3(
+            [&](int a, const futoin::string&) {
+                BOOST_CHECK_EQUAL(a, 234);
+                ++count;
+            });
+    tee.once(test_event2, handler3);
+    wait_at_halt();
 
-        handlers.emplace_back(std::ref(handler));
-        ee.once(test_event, handlers.back());
-    }
+    tee.off(test_event2, handler2);
+    tee.emit(test_event2, 234, futoin::string{"str"});
+    wait_at_halt();
 
-    at.immediate([&]() {
-        ee.emit(test_event, 123, "str");
-        ee.emit(test_event, 123, "str");
-        ee.emit(test_event, 123, "str");
+    // Typed events remain usable through untyped API
+    futoin::IEventEmitter& ee = tee;
+    TestEventEmitter::EventHandler handler4([&](int a) {
+        BOOST_CHECK_EQUAL(a, 345);
+        ++count;
     });
-
+    ee.once(test_event2, handler4);
+    ee.emit(test_event2, 345, futoin::string{"str"});
     wait_at_halt();
-    BOOST_CHECK_EQUAL(count.load(), HCOUNT * (6 + 3));
+
+    tee.off(test_event1, handler1);
+    BOOST_CHECK_EQUAL(count.load(), 4U);
 }
 
-BOOST_AUTO_TEST_CASE(edge_cases) // NOLINT
+BOOST_AUTO_TEST_CASE(coalesce) // NOLINT
 {
     TestEventEmitter tee{at};
     futoin::IEventEmitter& ee = tee;
-    std::atomic_size_t count{0};
+    std::vector<int> seen;
+    std::vector<int> seen_late;
+
+    TestEventEmitter::EventOptions options;
+    options.coalesce = true;
 
     futoin::IEventEmitter::EventType test_event{"TestEvent"};
-    tee.register_event<int, futoin::string>(test_event);
+    tee.register_event<int>(test_event, options);
 
-    auto handler = [&](int a) {
-        BOOST_CHECK_EQUAL(a, 123);
-        ++count;
-    };
+    TestEventEmitter::EventHandler handler([&](int a) { seen.push_back(a); });
+    TestEventEmitter::EventHandler late_handler(
+            [&](int a) { seen_late.push_back(a); });
+    ee.on(test_event, handler);
 
-    std::deque<futoin::IEventEmitter::EventHandler> handlers;
+    at.immediate([&]() {
+        for (auto i = 1; i <= 100; ++i) {
+            ee.emit(test_event, i);
 
-    handlers.emplace_back(std::ref(handler));
-    ee.on("TestEvent", handlers.back());
+            // Joins the pending dispatch as with a regular emit
+            if (i == 50) {
+                ee.once(test_event, late_handler);
+            }
+        }
+    });
+    wait_dispatched();
+
+    std::vector<int> expected{100};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen.begin(), seen.end(), expected.begin(), expected.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen_late.begin(),
+            seen_late.end(),
+            expected.begin(),
+            expected.end());
+
+    // Dispatched emits are not affected
+    at.immediate([&]() { ee.emit(test_event, 1); });
+    wait_dispatched();
+    at.immediate([&]() { ee.emit(test_event, 2); });
+    wait_dispatched();
+
+    expected = {100, 1, 2};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen.begin(), seen.end(), expected.begin(), expected.end());
 
-    auto f = [&]() {
-        ee.emit(test_event, 123, "str");
+    ee.off(test_event, handler);
+}
 
-        handlers.emplace_back(std::ref(handler));
-        ee.on("TestEvent", handlers.back());
-        handlers.emplace_back(std::ref(handler));
-        ee.once("TestEvent", handlers.back());
+BOOST_AUTO_TEST_CASE(rate_limit) // NOLINT
+{
+    using std::chrono::milliseconds;
 
-        at.immediate([&]() { BOOST_CHECK_EQUAL(count.load(), 1U); });
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+    std::vector<int> throttled;
+    std::vector<int> debounced;
+
+    TestEventEmitter::EventOptions options;
+    options.rate_limit = TestEventEmitter::RateLimit::throttle;
+    options.rate_interval = milliseconds(200);
+
+    futoin::IEventEmitter::EventType throttle_event{"ThrottleEvent"};
+    tee.register_event<int>(throttle_event, options);
+
+    options.rate_limit = TestEventEmitter::RateLimit::debounce;
+    options.rate_interval = milliseconds(100);
+
+    futoin::IEventEmitter::EventType debounce_event{"DebounceEvent"};
+    tee.register_event<int>(debounce_event, options);
+
+    TestEventEmitter::EventHandler throttle_handler(
+            [&](int a) { throttled.push_back(a); });
+    TestEventEmitter::EventHandler debounce_handler(
+            [&](int a) { debounced.push_back(a); });
+    ee.on(throttle_event, throttle_handler);
+    ee.on(debounce_event, debounce_handler);
+
+    // Burst of two intervals
+    for (auto round = 0; round < 2; ++round) {
+        at.immediate([&]() {
+            for (auto i = 1; i <= 100; ++i) {
+                ee.emit(throttle_event, round * 100 + i);
+                ee.emit(debounce_event, round * 100 + i);
+            }
+        });
+        std::this_thread::sleep_for(milliseconds(10));
+    }
 
-        ee.emit(test_event, 123, "str");
+    wait_dispatched();
+
+    std::vector<int> expected{1};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            throttled.begin(),
+            throttled.end(),
+            expected.begin(),
+            expected.end());
+    BOOST_CHECK(debounced.empty());
+
+    std::this_thread::sleep_for(milliseconds(400));
+    wait_dispatched();
+
+    expected = {1, 200};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            throttled.begin(),
+            throttled.end(),
+            expected.begin(),
+            expected.end());
+
+    expected = {200};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            debounced.begin(),
+            debounced.end(),
+            expected.begin(),
+            expected.end());
+
+    ee.off(throttle_event, throttle_handler);
+    ee.off(debounce_event, debounce_handler);
+}
 
-        at.immediate([&]() { BOOST_CHECK_EQUAL(count.load(), 4U); });
+BOOST_AUTO_TEST_CASE(rate_limit_options) // NOLINT
+{
+    using std::chrono::milliseconds;
 
-        ee.emit(test_event, 123, "str");
-        handlers.emplace_back(std::ref(handler));
-        ee.once("TestEvent", handlers.back());
-        handlers.emplace_back(std::ref(handler));
-        ee.once("TestEvent", handlers.back());
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+    std::vector<int> seen;
 
-        at.immediate([&]() { BOOST_CHECK_EQUAL(count.load(), 6U); });
+    // NOTE: interval is long enough to never fire in the test
+    TestEventEmitter::EventOptions options;
+    options.rate_limit = TestEventEmitter::RateLimit::throttle;
+    options.rate_interval = milliseconds(3600000);
 
-        ee.emit(test_event, 123, "str");
-        handlers.emplace_back(std::ref(handler));
-        ee.once("TestEvent", handlers.back());
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    tee.register_event<int>(test_event, options);
 
-        at.immediate([&]() { BOOST_CHECK_EQUAL(count.load(), 10U); });
-    };
+    TestEventEmitter::EventHandler handler([&](int a) { seen.push_back(a); });
+    ee.on(test_event, handler);
 
-    at.immediate(std::ref(f));
+    at.immediate([&]() {
+        for (auto i = 1; i <= 3; ++i) {
+            ee.emit(test_event, i);
+        }
+    });
+    wait_dispatched();
 
-    wait_at_halt();
-    BOOST_CHECK_EQUAL(count.load(), 10U);
+    std::vector<int> expected{1};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen.begin(), seen.end(), expected.begin(), expected.end());
+
+    // Held emit is delivered, not dropped with the limiter
+    tee.set_event_options(test_event, TestEventEmitter::EventOptions());
+
+    expected = {1, 3};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen.begin(), seen.end(), expected.begin(), expected.end());
+
+    // No limit anymore
+    at.immediate([&]() {
+        ee.emit(test_event, 4);
+        ee.emit(test_event, 5);
+    });
+    wait_dispatched();
+
+    expected = {1, 3, 4, 5};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen.begin(), seen.end(), expected.begin(), expected.end());
+
+    ee.off(test_event, handler);
 }
 
-BOOST_AUTO_TEST_CASE(stress) // NOLINT
+BOOST_AUTO_TEST_CASE(priority) // NOLINT
 {
-    struct TestData
-    {
-        TestData(futoin::ri::AsyncTool& at) noexcept : tee(at) {}
-
-        TestEventEmitter tee;
-        futoin::IEventEmitter& ee = tee;
-        std::size_t count{0};
-        std::promise<size_t> final_count;
-        bool done{false};
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+    std::vector<int> seen;
 
-        std::deque<futoin::IEventEmitter::EventHandler> handlers;
-        std::deque<futoin::IEventEmitter::EventHandler> once_handlers;
-        std::size_t once_next{0};
+    using Priority = TestEventEmitter::Priority;
+    TestEventEmitter::EventOptions options;
 
-        std::function<void(int)> simple;
-        std::function<void(int)> once_add;
-        static void once() {}
-        std::function<void()> emit;
-    };
+    futoin::IEventEmitter::EventType data_event{"DataEvent"};
+    tee.register_event<int>(data_event);
 
-    TestData td(at);
+    futoin::IEventEmitter::EventType control_event{"ControlEvent"};
+    options.priority = Priority::high;
+    tee.register_event<int>(control_event, options);
 
-    td.simple = [&](int) { ++(td.count); };
-    td.once_add = [&](int) {
-        td.ee.once("TestEvent", td.once_handlers[td.once_next]);
+    futoin::IEventEmitter::EventType idle_event{"IdleEvent"};
+    options.priority = Priority::low;
+    tee.register_event<int>(idle_event, options);
 
-        ++(td.once_next);
-        td.once_next %= td.once_handlers.size();
-    };
+    TestEventEmitter::EventHandler handler([&](int a) { seen.push_back(a); });
+    TestEventEmitter::EventHandler control_handler(
+            [&](int a) { seen.push_back(a); });
+    TestEventEmitter::EventHandler idle_handler(
+            [&](int a) { seen.push_back(a); });
+    ee.on(data_event, handler);
+    ee.on(control_event, control_handler);
+    ee.on(idle_event, idle_handler);
 
-    futoin::IEventEmitter::EventType test_event{"TestEvent"};
-    td.tee.register_event<int, futoin::string>(test_event);
-    TestEventEmitter::setMaxListeners(td.tee, 1000);
+    TestEventEmitter::setLaneTiming(tee, true);
 
-    td.emit = [&]() {
-        if (td.done) {
-            td.final_count.set_value(td.count);
-        } else {
-            td.ee.emit(test_event, 123, futoin::string{});
-            at.immediate(std::ref(td.emit));
-        }
-    };
+    for (auto batch : {1, 0}) {
+        TestEventEmitter::setDispatchBatch(tee, batch);
+        seen.clear();
 
-    at.immediate([&]() {
-        for (auto i = 0; i < 100; ++i) {
-            td.handlers.emplace_back(std::ref(td.simple));
-            td.ee.on("TestEvent", td.handlers.back());
+        at.immediate([&]() {
+            ee.emit(idle_event, 100);
 
-            td.handlers.emplace_back(std::ref(td.once_add));
-            td.ee.on("TestEvent", td.handlers.back());
+            for (auto i = 1; i <= 3; ++i) {
+                ee.emit(data_event, i);
+            }
 
-            td.once_handlers.emplace_back(&TestData::once);
-            td.once_handlers.emplace_back(&TestData::once);
-        }
+            ee.emit(control_event, -1);
+            ee.emit(control_event, -2);
+        });
+        wait_dispatched();
 
-        at.deferred(std::chrono::seconds(1), [&]() { td.done = true; });
+        std::vector<int> expected{-1, -2, 1, 2, 3, 100};
+        BOOST_CHECK_EQUAL_COLLECTIONS(
+                seen.begin(), seen.end(), expected.begin(), expected.end());
+    }
 
-        td.emit();
+    std::promise<void> done;
+    at.immediate([&]() {
+        auto high = TestEventEmitter::getLaneStats(tee, Priority::high);
+        auto normal = TestEventEmitter::getLaneStats(tee, Priority::normal);
+        auto low = TestEventEmitter::getLaneStats(tee, Priority::low);
+
+        BOOST_CHECK_EQUAL(high.dispatched, 4U);
+        BOOST_CHECK_EQUAL(normal.dispatched, 6U);
+        BOOST_CHECK_EQUAL(low.dispatched, 2U);
+        BOOST_CHECK(low.max_wait >= normal.max_wait);
+        BOOST_CHECK(low.total_wait >= low.max_wait);
+        done.set_value();
     });
+    done.get_future().wait();
 
-    auto count = td.final_count.get_future().get();
-    std::cout << "Stress count: " << count << std::endl;
-    BOOST_CHECK_GT(count, size_t(1e5));
+    ee.off(data_event, handler);
+    ee.off(control_event, control_handler);
+    ee.off(idle_event, idle_handler);
 }
 
-BOOST_AUTO_TEST_CASE(performance) // NOLINT
+BOOST_AUTO_TEST_CASE(overflow) // NOLINT
 {
-    struct TestData
-    {
-        TestData(futoin::ri::AsyncTool& at) noexcept : tee(at) {}
+    using OverflowPolicy = TestEventEmitter::OverflowPolicy;
 
-        TestEventEmitter tee;
-        futoin::IEventEmitter& ee = tee;
-        std::size_t count{0};
-        std::promise<size_t> final_count;
-        bool done{false};
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+    TestEventEmitter::setMaxPending(tee, 3, OverflowPolicy::drop_newest);
+
+    TestEventEmitter::EventOptions options;
+    options.max_pending = 3;
+
+    futoin::IEventEmitter::EventType newest_event{"DropNewest"};
+    tee.register_event<int>(newest_event);
+
+    futoin::IEventEmitter::EventType oldest_event{"DropOldest"};
+    options.overflow = OverflowPolicy::drop_oldest;
+    tee.register_event<int>(oldest_event, options);
+
+    futoin::IEventEmitter::EventType coalesce_event{"Coalesce"};
+    options.overflow = OverflowPolicy::coalesce;
+    tee.register_event<int>(coalesce_event, options);
+
+    futoin::IEventEmitter::EventType fail_event{"Fail"};
+    options.overflow = OverflowPolicy::fail;
+    tee.register_event<int>(fail_event, options);
+
+    std::vector<int> seen_newest;
+    std::vector<int> seen_oldest;
+    std::vector<int> seen_coalesce;
+    std::vector<int> seen_fail;
+    std::vector<bool> accepted;
+
+    TestEventEmitter::EventHandler newest_handler(
+            [&](int a) { seen_newest.push_back(a); });
+    TestEventEmitter::EventHandler oldest_handler(
+            [&](int a) { seen_oldest.push_back(a); });
+    TestEventEmitter::EventHandler coalesce_handler(
+            [&](int a) { seen_coalesce.push_back(a); });
+    TestEventEmitter::EventHandler fail_handler(
+            [&](int a) { seen_fail.push_back(a); });
+    ee.on(newest_event, newest_handler);
+    ee.on(oldest_event, oldest_handler);
+    ee.on(coalesce_event, coalesce_handler);
+    ee.on(fail_event, fail_handler);
 
-        futoin::IEventEmitter::EventHandler handler;
+    at.immediate([&]() {
+        for (auto i = 1; i <= 10; ++i) {
+            ee.emit(newest_event, i);
+            ee.emit(oldest_event, i);
+            ee.emit(coalesce_event, i);
+            accepted.push_back(tee.try_emit(fail_event, i));
+        }
+    });
+    wait_dispatched();
+
+    std::vector<int> expected{1, 2, 3};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen_newest.begin(),
+            seen_newest.end(),
+            expected.begin(),
+            expected.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen_fail.begin(),
+            seen_fail.end(),
+            expected.begin(),
+            expected.end());
+
+    expected = {8, 9, 10};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen_oldest.begin(),
+            seen_oldest.end(),
+            expected.begin(),
+            expected.end());
+
+    expected = {1, 2, 10};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen_coalesce.begin(),
+            seen_coalesce.end(),
+            expected.begin(),
+            expected.end());
+
+    BOOST_CHECK_EQUAL(std::count(accepted.begin(), accepted.end(), true), 3);
 
-        std::function<void(int)> simple;
-        std::function<void()> emit;
-    };
+    std::promise<void> done;
+    at.immediate([&]() {
+        auto stats = TestEventEmitter::getQueueStats(tee);
+        BOOST_CHECK_EQUAL(stats.dropped, 14U);
+        BOOST_CHECK_EQUAL(stats.coalesced, 7U);
+        done.set_value();
+    });
+    done.get_future().wait();
 
-    TestData td(at);
+    // Limit is for pending emits only
+    at.immediate([&]() { BOOST_CHECK(tee.try_emit(fail_event, 11)); });
+    wait_dispatched();
+    BOOST_CHECK_EQUAL(seen_fail.size(), 4U);
 
-    td.simple = [&](int) { ++(td.count); };
+    ee.off(newest_event, newest_handler);
+    ee.off(oldest_event, oldest_handler);
+    ee.off(coalesce_event, coalesce_handler);
+    ee.off(fail_event, fail_handler);
+}
+
+BOOST_AUTO_TEST_CASE(lazy_emit) // NOLINT
+{
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
 
     futoin::IEventEmitter::EventType test_event{"TestEvent"};
-    td.tee.register_event<int>(test_event);
+    tee.register_event<int>(test_event);
 
-    td.emit = [&]() {
-        if (td.done) {
-            td.final_count.set_value(td.count);
-        } else {
-            for (auto i = 0; i < 1000; ++i) {
-                td.ee.emit(test_event, 123);
-            }
-            at.immediate(std::ref(td.emit));
-        }
+    int built = 0;
+    std::vector<int> seen;
+    auto factory = [&]() -> futoin::IEventEmitter::NextArgs {
+        ++built;
+        return {built};
     };
 
-    at.immediate([&]() {
-        td.handler = std::ref(td.simple);
-        td.ee.on("TestEvent", td.handler);
+    TestEventEmitter::EventHandler handler([&](int a) { seen.push_back(a); });
+    TestEventEmitter::EventHandler once_handler([&](int) {});
+    TestEventEmitter::AnyEventHandler any_handler(
+            [&](TestEventEmitter::EventID,
+                const char*,
+                const futoin::IEventEmitter::NextArgs&) {});
 
-        at.deferred(std::chrono::seconds(1), [&]() { td.done = true; });
+    BOOST_CHECK(!tee.has_listeners(test_event));
+    BOOST_CHECK_EQUAL(tee.listener_count(test_event), 0U);
 
-        td.emit();
-    });
+    at.immediate([&]() { tee.emit_lazy(test_event, factory); });
+    wait_at_halt();
+    BOOST_CHECK_EQUAL(built, 0);
 
-    auto count = td.final_count.get_future().get();
-    std::cout << "Performance count: " << count << std::endl;
+    ee.on(test_event, handler);
+    ee.once(test_event, once_handler);
+    tee.on_any(any_handler);
+    BOOST_CHECK(tee.has_listeners(test_event));
+    BOOST_CHECK_EQUAL(tee.listener_count(test_event), 3U);
+
+    at.immediate([&]() { tee.emit_lazy(test_event, factory); });
+    wait_dispatched();
+    BOOST_CHECK_EQUAL(built, 1);
+    BOOST_CHECK_EQUAL(tee.listener_count(test_event), 2U);
+
+    // Cancelled once listener is not counted
+    ee.once(test_event, once_handler);
+    BOOST_CHECK_EQUAL(tee.listener_count(test_event), 3U);
+    ee.off(test_event, once_handler);
+    BOOST_CHECK_EQUAL(tee.listener_count(test_event), 2U);
+
+    ee.off(test_event, handler);
+    tee.off_any(any_handler);
+    BOOST_CHECK(!tee.has_listeners(test_event));
+
+    at.immediate([&]() { tee.emit_lazy(test_event, factory); });
+    wait_dispatched();
+    BOOST_CHECK_EQUAL(built, 1);
+
+    std::vector<int> expected{1};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen.begin(), seen.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(emit_batch) // NOLINT
+{
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    tee.register_event<int>(test_event);
+    futoin::IEventEmitter::EventType coalesce_event{"CoalesceEvent"};
+    TestEventEmitter::EventOptions options;
+    options.coalesce = true;
+    tee.register_event<int>(coalesce_event, options);
+
+    std::vector<int> seen;
+    std::vector<int> once_seen;
+    std::vector<int> coalesced;
+    TestEventEmitter::EventHandler handler([&](int a) { seen.push_back(a); });
+    TestEventEmitter::EventHandler once_handler(
+            [&](int a) { once_seen.push_back(a); });
+    TestEventEmitter::EventHandler coalesce_handler(
+            [&](int a) { coalesced.push_back(a); });
+
+    ee.on(test_event, handler);
+    ee.once(test_event, once_handler);
+    ee.on(coalesce_event, coalesce_handler);
+
+    auto make_batch = [](int from, int to) {
+        TestEventEmitter::ArgsBatch batch;
+
+        for (auto i = from; i < to; ++i) {
+            batch.emplace_back(i);
+        }
+
+        return batch;
+    };
+
+    at.immediate([&]() {
+        tee.emit_batch(test_event, make_batch(0, 5));
+        ee.emit(test_event, 5);
+        tee.emit_batch(test_event, {});
+        tee.emit_batch(test_event, make_batch(6, 7));
+
+        tee.emit_batch(coalesce_event, make_batch(0, 3));
+        tee.emit_batch(coalesce_event, make_batch(3, 6));
+    });
+    wait_dispatched();
+
+    // From other thread
+    tee.emit_batch(test_event, make_batch(7, 10));
+    wait_dispatched();
+
+    std::vector<int> expected(10);
+    std::iota(expected.begin(), expected.end(), 0);
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen.begin(), seen.end(), expected.begin(), expected.end());
+
+    std::vector<int> expected_once{0};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            once_seen.begin(),
+            once_seen.end(),
+            expected_once.begin(),
+            expected_once.end());
+
+    std::vector<int> expected_coalesced{5};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            coalesced.begin(),
+            coalesced.end(),
+            expected_coalesced.begin(),
+            expected_coalesced.end());
+
+    ee.off(test_event, handler);
+    ee.off(coalesce_event, coalesce_handler);
+}
+
+BOOST_AUTO_TEST_CASE(on_any) // NOLINT
+{
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+
+    futoin::IEventEmitter::EventType first_event{"FirstEvent"};
+    tee.register_event<int>(first_event);
+    futoin::IEventEmitter::EventType second_event{"SecondEvent"};
+    tee.register_event(second_event);
+
+    std::vector<std::string> seen;
+    int regular = 0;
+
+    TestEventEmitter::AnyEventHandler any_handler(
+            [&](TestEventEmitter::EventID event_id,
+                const char* name,
+                const futoin::IEventEmitter::NextArgs&) {
+                seen.push_back(std::to_string(event_id) + ":" + name);
+            });
+    TestEventEmitter::EventHandler handler([&](int) { ++regular; });
+
+    tee.on_any(any_handler);
+    ee.on(first_event, handler);
+
+    at.immediate([&]() {
+        ee.emit(first_event, 1);
+        // No regular listeners
+        ee.emit(second_event);
+    });
+    wait_dispatched();
+
+    std::vector<std::string> expected{"1:FirstEvent", "2:SecondEvent"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen.begin(), seen.end(), expected.begin(), expected.end());
+    BOOST_CHECK_EQUAL(regular, 1);
+
+    tee.off_any(any_handler);
+
+    at.immediate([&]() {
+        ee.emit(first_event, 2);
+        ee.emit(second_event);
+    });
+    wait_dispatched();
+
+    BOOST_CHECK_EQUAL(seen.size(), 2U);
+    BOOST_CHECK_EQUAL(regular, 2);
+
+    ee.off(first_event, handler);
+}
+
+BOOST_AUTO_TEST_CASE(forward) // NOLINT
+{
+    futoin::ri::AsyncTool worker;
+    TestEventEmitter inner{at};
+    TestEventEmitter facade{at};
+    TestEventEmitter top{at};
+    futoin::IEventEmitter& inner_ee = inner;
+    futoin::IEventEmitter& facade_ee = facade;
+    futoin::IEventEmitter& top_ee = top;
+
+    futoin::IEventEmitter::EventType inner_event{"InnerEvent"};
+    inner.register_event<int>(inner_event);
+    futoin::IEventEmitter::EventType facade_event{"FacadeEvent"};
+    facade.register_event<int>(facade_event);
+    futoin::IEventEmitter::EventType top_event{"TopEvent"};
+    top.register_event<int>(top_event);
+
+    std::vector<std::string> seen;
+    std::promise<void> remote_done;
+
+    TestEventEmitter::EventHandler inner_handler(
+            [&](int a) { seen.push_back("inner" + std::to_string(a)); });
+    TestEventEmitter::EventHandler facade_handler(
+            [&](int a) { seen.push_back("facade" + std::to_string(a)); });
+    TestEventEmitter::EventHandler facade_once(
+            [&](int a) { seen.push_back("once" + std::to_string(a)); });
+    TestEventEmitter::EventHandler top_handler(
+            [&](int a) { seen.push_back("top" + std::to_string(a)); });
+    int self_off_count = 0;
+    TestEventEmitter::EventHandler self_off_handler;
+    self_off_handler = [&](int) {
+        ++self_off_count;
+        facade_ee.off(facade_event, self_off_handler);
+    };
+    TestEventEmitter::EventHandler remote_handler([&](int a) {
+        BOOST_CHECK(worker.is_same_thread());
+        BOOST_CHECK_EQUAL(a, 1);
+        remote_done.set_value();
+    });
+
+    inner_ee.on(inner_event, inner_handler);
+    facade_ee.on(facade_event, self_off_handler);
+    facade_ee.on(facade_event, facade_handler);
+    facade_ee.once(facade_event, facade_once);
+    facade.once(facade_event, remote_handler, worker);
+    top_ee.on(top_event, top_handler);
+
+    inner.forward(inner_event, facade, facade_event);
+    facade.forward(facade_event, top, top_event);
+
+    BOOST_CHECK_EQUAL(facade.listener_count(facade_event), 5U);
+
+    at.immediate([&]() {
+        inner_ee.emit(inner_event, 1);
+        // Forwarded directly, not queued after the next emit
+        facade_ee.emit(facade_event, 10);
+        inner_ee.emit(inner_event, 2);
+    });
+    wait_dispatched();
+    remote_done.get_future().wait();
+
+    std::vector<std::string> expected{"inner1",
+                                      "facade1",
+                                      "once1",
+                                      "top1",
+                                      "facade10",
+                                      "top10",
+                                      "inner2",
+                                      "facade2",
+                                      "top2"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen.begin(), seen.end(), expected.begin(), expected.end());
+    BOOST_CHECK_EQUAL(self_off_count, 1);
+
+    // No listeners of own, but still observed through forward
+    inner_ee.off(inner_event, inner_handler);
+    BOOST_CHECK(inner.has_listeners(inner_event));
+
+    inner.unforward(inner_event, facade, facade_event);
+    BOOST_CHECK(!inner.has_listeners(inner_event));
+    seen.clear();
+
+    at.immediate([&]() {
+        inner_ee.emit(inner_event, 3);
+        facade_ee.emit(facade_event, 4);
+    });
+    wait_dispatched();
+
+    expected = {"facade4", "top4"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen.begin(), seen.end(), expected.begin(), expected.end());
+
+    facade.unforward(facade_event, top, top_event);
+    facade_ee.off(facade_event, facade_handler);
+    top_ee.off(top_event, top_handler);
+}
+
+BOOST_AUTO_TEST_CASE(forward_queued) // NOLINT
+{
+    TestEventEmitter inner{at};
+    TestEventEmitter facade{at};
+    futoin::IEventEmitter& inner_ee = inner;
+    futoin::IEventEmitter& facade_ee = facade;
+
+    futoin::IEventEmitter::EventType inner_event{"InnerEvent"};
+    inner.register_event(inner_event);
+    futoin::IEventEmitter::EventType facade_event{"FacadeEvent"};
+    facade.register_event(facade_event);
+
+    int count = 0;
+    int once_count = 0;
+    TestEventEmitter::EventHandler handler([&]() { ++count; });
+    TestEventEmitter::EventHandler once_handler([&]() { ++once_count; });
+
+    inner.forward(inner_event, facade, facade_event);
+    facade_ee.on(facade_event, handler);
+
+    at.immediate([&]() {
+        inner_ee.emit(inner_event);
+        // Queued before the forwarded emit gets dispatched
+        facade_ee.emit(facade_event);
+        facade_ee.once(facade_event, once_handler);
+    });
+    wait_dispatched();
+
+    BOOST_CHECK_EQUAL(count, 2);
+    BOOST_CHECK_EQUAL(once_count, 0);
+    BOOST_CHECK_EQUAL(facade.listener_count(facade_event), 2U);
+
+    at.immediate([&]() { facade_ee.emit(facade_event); });
+    wait_dispatched();
+
+    BOOST_CHECK_EQUAL(count, 3);
+    BOOST_CHECK_EQUAL(once_count, 1);
+
+    inner.unforward(inner_event, facade, facade_event);
+    facade_ee.off(facade_event, handler);
+}
+
+BOOST_AUTO_TEST_CASE(metrics) // NOLINT
+{
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    tee.register_event<int>(test_event);
+
+    int count = 0;
+    TestEventEmitter::EventHandler handler([&](int) { ++count; });
+    TestEventEmitter::EventHandler once_handler([&](int) { ++count; });
+    TestEventEmitter::EventHandler removed_handler([&](int) { ++count; });
+    ee.on(test_event, handler);
+    ee.once(test_event, once_handler);
+    ee.on(test_event, removed_handler);
+    ee.off(test_event, removed_handler);
+
+    at.immediate([&]() {
+        for (auto i = 0; i < 10; ++i) {
+            ee.emit(test_event, i);
+        }
+    });
+
+    // Snapshot from other thread
+    auto snapshot = TestEventEmitter::getMetrics(tee);
+    wait_dispatched();
+    snapshot = TestEventEmitter::getMetrics(tee);
+
+    BOOST_CHECK_EQUAL(count, 11);
+
+#ifdef FUTOIN_EVENTEMITTER_METRICS
+    BOOST_REQUIRE_EQUAL(snapshot.size(), 1U);
+
+    auto& em = snapshot[0];
+    BOOST_CHECK_EQUAL(em.name, "TestEvent");
+    BOOST_CHECK_EQUAL(em.emits, 10U);
+    BOOST_CHECK_EQUAL(em.deliveries, 10U);
+    BOOST_CHECK_EQUAL(em.once_deliveries, 1U);
+    BOOST_CHECK_EQUAL(em.tombstones, 1U);
+    BOOST_CHECK_EQUAL(em.peak_pending, 10U);
+    BOOST_CHECK_EQUAL(
+            std::accumulate(
+                    em.wait_histogram.begin(),
+                    em.wait_histogram.end(),
+                    std::uint64_t(0)),
+            10U);
+#else
+    BOOST_CHECK(snapshot.empty());
+#endif
+
+    ee.off(test_event, handler);
+}
+
+BOOST_AUTO_TEST_CASE(listener_timing) // NOLINT
+{
+    using std::chrono::milliseconds;
+
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    tee.register_event<int>(test_event);
+
+    std::vector<std::size_t> slow;
+    TestEventEmitter::EventHandler fast_handler([](int) {});
+    TestEventEmitter::EventHandler slow_handler(
+            [](int) { std::this_thread::sleep_for(milliseconds(2)); });
+
+    ee.on(test_event, fast_handler);
+    ee.on(test_event, slow_handler);
+
+    TestEventEmitter::ListenerTiming timing;
+    timing.sample_every = 2;
+    timing.budget = milliseconds(1);
+    timing.on_slow = [&](const char* name,
+                         std::size_t index,
+                         std::chrono::nanoseconds elapsed) {
+        BOOST_CHECK_EQUAL(name, "TestEvent");
+        BOOST_CHECK(elapsed >= milliseconds(2));
+        slow.push_back(index);
+    };
+
+    std::promise<void> done;
+    at.immediate([&]() {
+        TestEventEmitter::setListenerTiming(tee, timing);
+
+        for (auto i = 0; i < 4; ++i) {
+            ee.emit(test_event, i);
+        }
+
+        at.immediate([&]() { done.set_value(); });
+    });
+    done.get_future().wait();
+    wait_at_halt();
+
+    std::vector<std::size_t> expected_slow{1, 1};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            slow.begin(),
+            slow.end(),
+            expected_slow.begin(),
+            expected_slow.end());
+
+    std::promise<void> checked;
+    at.immediate([&]() {
+        auto stats = TestEventEmitter::getEventTiming(tee, test_event);
+
+        BOOST_CHECK_EQUAL(stats.total.samples, 4U);
+        BOOST_REQUIRE_EQUAL(stats.listeners.size(), 2U);
+        BOOST_CHECK_EQUAL(stats.listeners[0].samples, 2U);
+        BOOST_CHECK_EQUAL(stats.listeners[1].samples, 2U);
+        BOOST_CHECK(stats.listeners[1].total >= milliseconds(4));
+        BOOST_CHECK(stats.listeners[1].max >= milliseconds(2));
+        BOOST_CHECK(stats.listeners[1].max >= stats.listeners[0].max);
+
+        // Disabled
+        TestEventEmitter::setListenerTiming(
+                tee, TestEventEmitter::ListenerTiming());
+        ee.emit(test_event, 5);
+        checked.set_value();
+    });
+    checked.get_future().wait();
+    wait_at_halt();
+
+    BOOST_CHECK_EQUAL(slow.size(), 2U);
+
+    std::promise<void> unchanged;
+    at.immediate([&]() {
+        auto stats = TestEventEmitter::getEventTiming(tee, test_event);
+        BOOST_CHECK_EQUAL(stats.total.samples, 4U);
+        unchanged.set_value();
+    });
+    unchanged.get_future().wait();
+
+    ee.off(test_event, fast_handler);
+    ee.off(test_event, slow_handler);
+}
+
+BOOST_AUTO_TEST_CASE(affinity) // NOLINT
+{
+    const int COUNT = 100;
+
+    futoin::ri::AsyncTool worker;
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    tee.register_event<int>(test_event);
+
+    std::vector<int> seen_local;
+    std::vector<int> seen_remote;
+    std::vector<int> seen_once;
+    std::promise<void> local_done;
+    std::promise<void> remote_done;
+    auto local_done_f = local_done.get_future().share();
+
+    TestEventEmitter::EventHandler handler([&](int a) {
+        seen_local.push_back(a);
+
+        if (a == COUNT) {
+            local_done.set_value();
+        }
+    });
+    TestEventEmitter::EventHandler slow_handler([&](int a) {
+        BOOST_CHECK(worker.is_same_thread());
+
+        // Must not block the producer loop
+        if (a == 1) {
+            BOOST_CHECK(
+                    local_done_f.wait_for(std::chrono::seconds(10))
+                    == std::future_status::ready);
+        }
+
+        seen_remote.push_back(a);
+
+        if (a == COUNT) {
+            remote_done.set_value();
+        }
+    });
+    TestEventEmitter::EventHandler once_handler([&](int a) {
+        BOOST_CHECK(worker.is_same_thread());
+        seen_once.push_back(a);
+    });
+
+    tee.on(test_event, slow_handler, worker);
+    tee.once(test_event, once_handler, worker);
+    ee.on(test_event, handler);
+
+    at.immediate([&]() {
+        for (auto i = 1; i <= COUNT; ++i) {
+            ee.emit(test_event, i);
+        }
+    });
+
+    remote_done.get_future().wait();
+    wait_at_halt();
+
+    std::vector<int> expected;
+
+    for (auto i = 1; i <= COUNT; ++i) {
+        expected.push_back(i);
+    }
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen_local.begin(),
+            seen_local.end(),
+            expected.begin(),
+            expected.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen_remote.begin(),
+            seen_remote.end(),
+            expected.begin(),
+            expected.end());
+    BOOST_CHECK_EQUAL(seen_once.size(), 1U);
+
+    // Delivery stops after off()
+    ee.off(test_event, slow_handler);
+    at.immediate([&]() { ee.emit(test_event, 0); });
+    wait_dispatched();
+
+    std::promise<void> worker_idle;
+    worker.immediate([&]() { worker_idle.set_value(); });
+    worker_idle.get_future().wait();
+
+    BOOST_CHECK_EQUAL(seen_remote.size(), std::size_t(COUNT));
+    BOOST_CHECK_EQUAL(seen_local.size(), std::size_t(COUNT + 1));
+
+    ee.off(test_event, handler);
+}
+
+BOOST_AUTO_TEST_CASE(affinity_off) // NOLINT
+{
+    CountingMemPool mem_pool;
+    futoin::ri::AsyncTool worker;
+
+    {
+        TestEventEmitter tee{at, mem_pool};
+        futoin::IEventEmitter& ee = tee;
+
+        futoin::IEventEmitter::EventType test_event{"TestEvent"};
+        tee.register_event<int>(test_event);
+
+        std::promise<void> entered;
+        std::promise<void> proceed;
+        auto proceed_f = proceed.get_future().share();
+        std::atomic_bool finished{false};
+
+        TestEventEmitter::EventHandler slow_handler([&](int) {
+            entered.set_value();
+            proceed_f.wait();
+            finished = true;
+        });
+        tee.on(test_event, slow_handler, worker);
+
+        at.immediate([&]() { ee.emit(test_event, 1); });
+        entered.get_future().wait();
+
+        // off() from other thread returns only after the running call
+        std::atomic_bool off_done{false};
+        std::thread off_thread([&]() {
+            ee.off(test_event, slow_handler);
+            off_done = true;
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        BOOST_CHECK(!off_done);
+
+        proceed.set_value();
+        off_thread.join();
+        BOOST_CHECK(finished);
+
+        // off() in event loop never waits for the running call
+        std::promise<void> loop_entered;
+        std::promise<void> loop_proceed;
+        auto loop_proceed_f = loop_proceed.get_future().share();
+        std::atomic_bool loop_finished{false};
+        std::promise<void> loop_done;
+
+        TestEventEmitter::EventHandler loop_handler([&](int) {
+            loop_entered.set_value();
+            loop_proceed_f.wait();
+
+            // Blocking API of the emitter is still served
+            BOOST_CHECK_EQUAL(tee.listener_count(test_event), 0U);
+            loop_finished = true;
+            loop_done.set_value();
+        });
+        tee.on(test_event, loop_handler, worker);
+
+        at.immediate([&]() { ee.emit(test_event, 2); });
+        loop_entered.get_future().wait();
+
+        std::promise<void> loop_off;
+        at.immediate([&]() {
+            ee.off(test_event, loop_handler);
+            loop_off.set_value();
+        });
+        BOOST_CHECK(
+                loop_off.get_future().wait_for(std::chrono::seconds(10))
+                == std::future_status::ready);
+        BOOST_CHECK(!loop_finished);
+
+        loop_proceed.set_value();
+        loop_done.get_future().wait();
+
+        // Handler may remove itself from within the call
+        std::promise<void> self_done;
+        TestEventEmitter::EventHandler* self_p = nullptr;
+        TestEventEmitter::EventHandler self_handler([&](int) {
+            ee.off(test_event, *self_p);
+            self_done.set_value();
+        });
+        self_p = &self_handler;
+        tee.on(test_event, self_handler, worker);
+
+        at.immediate([&]() { ee.emit(test_event, 3); });
+        self_done.get_future().wait();
+        BOOST_CHECK(!tee.has_listeners(test_event));
+
+        std::promise<void> worker_idle;
+        worker.immediate([&]() { worker_idle.set_value(); });
+        worker_idle.get_future().wait();
+    }
+
+    BOOST_CHECK_EQUAL(mem_pool.allocated.load(), mem_pool.deallocated.load());
+}
+
+BOOST_AUTO_TEST_CASE(emit_now) // NOLINT
+{
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+    std::vector<int> seen;
+
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    tee.register_event<int>(test_event);
+
+    TestEventEmitter::EventHandler handler3([&](int a) { seen.push_back(a); });
+    TestEventEmitter::EventHandler handler1([&](int a) {
+        seen.push_back(-a);
+
+        if (a == 2) {
+            ee.off(test_event, handler3);
+        }
+    });
+    TestEventEmitter::EventHandler handler2([&](int a) { seen.push_back(a); });
+
+    at.immediate([&]() {
+        ee.on(test_event, handler1);
+        ee.once(test_event, handler2);
+        ee.on(test_event, handler3);
+
+        tee.emit_now(test_event, 1);
+        BOOST_CHECK_EQUAL(seen.size(), 3U);
+
+        // handler3 is removed during dispatch
+        tee.emit_now(test_event, 2);
+        BOOST_CHECK_EQUAL(seen.size(), 4U);
+
+        // Queued emits keep their order
+        ee.emit(test_event, 3);
+        tee.emit_now(test_event, 4);
+        BOOST_CHECK_EQUAL(seen.size(), 4U);
+    });
+    wait_dispatched();
+
+    std::vector<int> expected{-1, 1, 1, -2, -3, -4};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen.begin(), seen.end(), expected.begin(), expected.end());
+
+    // From other thread, delivered before return
+    seen.clear();
+    tee.emit_now(test_event, 5);
+    expected = {-5};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen.begin(), seen.end(), expected.begin(), expected.end());
+
+    ee.off(test_event, handler1);
+}
+
+BOOST_AUTO_TEST_CASE(multiple) // NOLINT
+{
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+    std::atomic_size_t count{0};
+    const size_t HCOUNT = 10;
+
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    tee.register_event<int, futoin::string>(test_event);
+
+    auto handler = [&](int a) {
+        BOOST_CHECK_EQUAL(a, 123);
+        ++count;
+    };
+
+    std::deque<futoin::IEventEmitter::EventHandler> handlers;
+
+    for (auto i = HCOUNT; i > 0; --i) {
+        handlers.emplace_back(std::ref(handler));
+        ee.on("TestEvent", handlers.back());
+
+        handlers.emplace_back(std::ref(handler));
+        ee.on("TestEvent", handlers.back());
+
+        handlers.emplace_back(std::ref(handler));
+        ee.once(test_event, handlers.back());
+
+        handlers.emplace_back(std::ref(handler));
+        ee.once(test_event, handlers.back());
+
+        handlers.emplace_back(std::ref(handler));
+        ee.once(test_event, handlers.back());
+    }
+
+    at.immediate([&]() {
+        ee.emit(test_event, 123, "str");
+        ee.emit(test_event, 123, "str");
+        ee.emit(test_event, 123, "str");
+    });
+
+    wait_dispatched();
+    BOOST_CHECK_EQUAL(count.load(), HCOUNT * (6 + 3));
+}
+
+BOOST_AUTO_TEST_CASE(edge_cases) // NOLINT
+{
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+    std::atomic_size_t count{0};
+
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    tee.register_event<int, futoin::string>(test_event);
+
+    auto handler = [&](int a) {
+        BOOST_CHECK_EQUAL(a, 123);
+        ++count;
+    };
+
+    std::deque<futoin::IEventEmitter::EventHandler> handlers;
+
+    handlers.emplace_back(std::ref(handler));
+    ee.on("TestEvent", handlers.back());
+
+    auto f = [&]() {
+        ee.emit(test_event, 123, "str");
+
+        handlers.emplace_back(std::ref(handler));
+        ee.on("TestEvent", handlers.back());
+        handlers.emplace_back(std::ref(handler));
+        ee.once("TestEvent", handlers.back());
+
+        at.immediate([&]() { BOOST_CHECK_EQUAL(count.load(), 1U); });
+
+        ee.emit(test_event, 123, "str");
+
+        at.immediate([&]() { BOOST_CHECK_EQUAL(count.load(), 4U); });
+
+        ee.emit(test_event, 123, "str");
+        handlers.emplace_back(std::ref(handler));
+        ee.once("TestEvent", handlers.back());
+        handlers.emplace_back(std::ref(handler));
+        ee.once("TestEvent", handlers.back());
+
+        at.immediate([&]() { BOOST_CHECK_EQUAL(count.load(), 6U); });
+
+        ee.emit(test_event, 123, "str");
+        handlers.emplace_back(std::ref(handler));
+        ee.once("TestEvent", handlers.back());
+
+        at.immediate([&]() { BOOST_CHECK_EQUAL(count.load(), 10U); });
+    };
+
+    at.immediate(std::ref(f));
+
+    wait_dispatched();
+    BOOST_CHECK_EQUAL(count.load(), 10U);
+}
+
+BOOST_AUTO_TEST_CASE(dispatch_batch) // NOLINT
+{
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+    std::vector<int> seen;
+    std::promise<void> done;
+
+    TestEventEmitter::setDispatchBatch(tee, 2);
+
+    futoin::IEventEmitter::EventType test_event1{"TestEvent1"};
+    tee.register_event<int>(test_event1);
+    futoin::IEventEmitter::EventType test_event2{"TestEvent2"};
+    tee.register_event<int>(test_event2);
+
+    TestEventEmitter::EventHandler handler1([&](int a) { seen.push_back(a); });
+    TestEventEmitter::EventHandler handler2([&](int a) {
+        seen.push_back(-a);
+
+        if (a == 5) {
+            done.set_value();
+        }
+    });
+    ee.on(test_event1, handler1);
+    ee.on(test_event2, handler2);
+
+    at.immediate([&]() {
+        for (auto i = 1; i <= 5; ++i) {
+            ee.emit(test_event1, i);
+            ee.emit(test_event2, i);
+        }
+    });
+
+    done.get_future().wait();
+    wait_at_halt();
+
+    std::vector<int> expected{1, -1, 2, -2, 3, -3, 4, -4, 5, -5};
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            seen.begin(), seen.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(cross_thread) // NOLINT
+{
+    const int PRODUCERS = 4;
+    const int PER_PRODUCER = 100000;
+
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    tee.register_event<int, int>(test_event);
+
+    std::vector<int> last(PRODUCERS, -1);
+    std::size_t count = 0;
+    std::size_t reordered = 0;
+    std::promise<void> done;
+
+    TestEventEmitter::EventHandler handler([&](int producer, int seq) {
+        // Order is kept per producer
+        if (last[producer] >= seq) {
+            ++reordered;
+        }
+
+        last[producer] = seq;
+
+        if (++count == PRODUCERS * PER_PRODUCER) {
+            done.set_value();
+        }
+    });
+    ee.on(test_event, handler);
+
+    std::vector<std::thread> producers;
+
+    for (int p = 0; p < PRODUCERS; ++p) {
+        producers.emplace_back([&, p]() {
+            for (int i = 0; i < PER_PRODUCER; ++i) {
+                ee.emit(test_event, p, i);
+            }
+        });
+    }
+
+    for (auto& t : producers) {
+        t.join();
+    }
+
+    done.get_future().wait();
+    wait_at_halt();
+
+    BOOST_CHECK_EQUAL(count, std::size_t(PRODUCERS * PER_PRODUCER));
+    BOOST_CHECK_EQUAL(reordered, 0U);
+
+    for (auto seq : last) {
+        BOOST_CHECK_EQUAL(seq, PER_PRODUCER - 1);
+    }
+
+    ee.off(test_event, handler);
+}
+
+BOOST_AUTO_TEST_CASE(name_lookup) // NOLINT
+{
+    // NOTE: enough names sharing a prefix to get bucket collisions
+    const int EVENT_COUNT = 1000;
+
+    futoin::ri::EventSchema schema;
+    futoin::IEventEmitter::EventType schema_event("SchemaEvent");
+    schema.add<int>(schema_event);
+
+    TestEventEmitter tee{at, schema};
+    futoin::IEventEmitter& ee = tee;
+
+    std::deque<std::string> names;
+    std::deque<futoin::IEventEmitter::EventType> events;
+    std::deque<TestEventEmitter::EventHandler> handlers;
+    std::vector<int> sums(EVENT_COUNT + 1, 0);
+
+    for (auto i = 0; i <= EVENT_COUNT; ++i) {
+        handlers.emplace_back([&sums, i](int v) { sums[i] += v; });
+    }
+
+    std::promise<void> done;
+
+    at.immediate([&]() {
+        // Misses of own index, as no double registration
+        for (auto i = 0; i < EVENT_COUNT; ++i) {
+            names.emplace_back("TestEvent" + std::to_string(i));
+            events.emplace_back(names.back().c_str());
+            tee.register_event<int>(events.back());
+        }
+
+        // Hits by name of other storage, so not by pointer
+        for (auto i = 0; i < EVENT_COUNT; ++i) {
+            const auto name = names[i];
+            ee.on(name.c_str(), handlers[i]);
+        }
+
+        // Miss of own index, hit of schema
+        ee.on("SchemaEvent", handlers[EVENT_COUNT]);
+
+        std::size_t misplaced = 0;
+
+        for (auto i = 0; i < EVENT_COUNT; ++i) {
+            if (tee.listener_count(events[i]) != 1) {
+                ++misplaced;
+            }
+        }
+
+        BOOST_CHECK_EQUAL(misplaced, 0U);
+        BOOST_CHECK_EQUAL(tee.listener_count(schema_event), 1U);
+
+        for (auto i = 0; i < EVENT_COUNT; ++i) {
+            ee.emit(events[i], i + 1);
+        }
+
+        ee.emit(schema_event, -1);
+
+        done.set_value();
+    });
+
+    done.get_future().wait();
+    wait_dispatched();
+
+    // Each name reached only own event
+    std::size_t wrong_sums = 0;
+
+    for (auto i = 0; i < EVENT_COUNT; ++i) {
+        if (sums[i] != i + 1) {
+            ++wrong_sums;
+        }
+    }
+
+    BOOST_CHECK_EQUAL(wrong_sums, 0U);
+    BOOST_CHECK_EQUAL(sums[EVENT_COUNT], -1);
+
+    std::promise<void> off_done;
+
+    at.immediate([&]() {
+        for (auto i = 0; i < EVENT_COUNT; ++i) {
+            ee.off(names[i].c_str(), handlers[i]);
+        }
+
+        ee.off("SchemaEvent", handlers[EVENT_COUNT]);
+
+        std::size_t left = 0;
+
+        for (auto i = 0; i < EVENT_COUNT; ++i) {
+            left += tee.listener_count(events[i]);
+        }
+
+        BOOST_CHECK_EQUAL(left, 0U);
+        BOOST_CHECK(!tee.has_listeners(schema_event));
+        off_done.set_value();
+    });
+
+    off_done.get_future().wait();
+}
+
+BOOST_AUTO_TEST_CASE(schema) // NOLINT
+{
+    // Schema must not be usable as emitter
+    static_assert(
+            !std::is_convertible<
+                    futoin::ri::EventSchema*,
+                    futoin::IEventEmitter*>::value,
+            "EventSchema is not an emitter");
+
+    futoin::ri::EventSchema schema;
+    futoin::IEventEmitter::EventType data_event("DataEvent");
+    TestEventEmitter::TypedEventType<int> typed_event("TypedEvent");
+    schema.add<int>(data_event);
+    schema.add(typed_event);
+    BOOST_CHECK_EQUAL(schema.size(), 2U);
+
+    TestEventEmitter first{at, schema};
+    TestEventEmitter second{at, schema};
+    futoin::IEventEmitter& ee1 = first;
+    futoin::IEventEmitter& ee2 = second;
+
+    // Own events go after schema ones
+    futoin::IEventEmitter::EventType own_event("OwnEvent");
+    first.register_event(own_event);
+
+    int first_sum = 0;
+    int second_sum = 0;
+    int own_count = 0;
+    TestEventEmitter::EventHandler first_handler(
+            [&](int v) { first_sum += v; });
+    TestEventEmitter::EventHandler second_handler(
+            [&](int v) { second_sum += v; });
+    TestEventEmitter::TypedEventHandler<int> typed_handler(
+            [&](int v) { second_sum += v * 100; });
+    TestEventEmitter::EventHandler own_handler([&]() { ++own_count; });
+
+    // Not yet used by the emitter, queued from foreign thread
+    ee1.on(data_event, first_handler);
+    ee2.on("DataEvent", second_handler);
+    second.on(typed_event, typed_handler);
+    ee1.on(own_event, own_handler);
+
+    std::promise<void> done;
+    at.immediate([&]() {
+        ee1.emit(data_event, 1);
+        ee2.emit(data_event, 2);
+        ee2.emit("DataEvent", 3);
+        second.emit(typed_event, 4);
+        ee1.emit(own_event);
+        done.set_value();
+    });
+    done.get_future().wait();
+    wait_at_halt();
+
+    BOOST_CHECK_EQUAL(first_sum, 1);
+    BOOST_CHECK_EQUAL(second_sum, 405);
+    BOOST_CHECK_EQUAL(own_count, 1);
+    BOOST_CHECK(first.has_listeners(data_event));
+    BOOST_CHECK(!first.has_listeners(typed_event));
+
+    ee1.off(data_event, first_handler);
+    ee2.off(data_event, second_handler);
+    second.off(typed_event, typed_handler);
+    ee1.off(own_event, own_handler);
+}
+
+BOOST_AUTO_TEST_CASE(mem_pool) // NOLINT
+{
+    CountingMemPool mem_pool;
+
+    {
+        TestEventEmitter tee{at, mem_pool};
+        futoin::IEventEmitter& ee = tee;
+        std::size_t count = 0;
+
+        futoin::IEventEmitter::EventType test_event{"TestEvent"};
+        tee.register_event<int>(test_event);
+
+        TestEventEmitter::EventHandler handler([&](int) { ++count; });
+        ee.on(test_event, handler);
+
+        auto emit_batch = [&]() {
+            for (auto i = 0; i < 100; ++i) {
+                ee.emit(test_event, i);
+            }
+        };
+        auto run_batch = [&]() {
+            at.immediate(std::ref(emit_batch));
+            wait_dispatched();
+        };
+
+        // Warm up
+        run_batch();
+
+        const auto warm_allocated = mem_pool.allocated.load();
+        test::heap_allocations = 0;
+
+        // NOTE: only the event loop thread is counted
+        at.immediate([]() { test::count_heap = true; });
+
+        for (auto i = 0; i < 100; ++i) {
+            run_batch();
+        }
+
+        at.immediate([]() { test::count_heap = false; });
+        wait_at_halt();
+
+        BOOST_CHECK_EQUAL(count, 101U * 100U);
+        BOOST_CHECK_EQUAL(mem_pool.allocated.load(), warm_allocated);
+        BOOST_CHECK_EQUAL(test::heap_allocations.load(), 0U);
+        ee.off(test_event, handler);
+    }
+
+    BOOST_CHECK_GT(mem_pool.allocated.load(), 0U);
+    BOOST_CHECK_EQUAL(
+            mem_pool.allocated.load(), mem_pool.deallocated.load());
+}
+
+BOOST_AUTO_TEST_CASE(idle_footprint) // NOLINT
+{
+    struct SizeMemPool : futoin::IMemPool
+    {
+        void* allocate(
+                std::size_t object_size, std::size_t count) noexcept override
+        {
+            used += object_size * count;
+            return ::operator new(object_size * count);
+        }
+
+        void deallocate(
+                void* ptr,
+                std::size_t object_size,
+                std::size_t count) noexcept override
+        {
+            used -= object_size * count;
+            ::operator delete(ptr);
+        }
+
+        void release_memory() noexcept override {}
+
+        std::size_t used{0};
+    };
+
+    const std::size_t IDLE_COUNT = 1000000;
+    const std::size_t ACTIVE_COUNT = 10000;
+
+    futoin::ri::EventSchema schema;
+    TestEventEmitter::TypedEventType<int> test_event("TestEvent");
+    schema.add(test_event);
+
+    SizeMemPool mem_pool;
+    std::deque<TestEventEmitter> emitters;
+
+    for (std::size_t i = 0; i < IDLE_COUNT; ++i) {
+        emitters.emplace_back(at, mem_pool, schema);
+        futoin::IEventEmitter& ee = emitters.back();
+        ee.emit(test_event, int(i));
+        emitters.back().emit(test_event, int(i));
+    }
+
+    BOOST_CHECK_EQUAL(mem_pool.used, 0U);
+    BOOST_CHECK(!emitters.back().has_listeners(test_event));
+    BOOST_CHECK_EQUAL(mem_pool.used, 0U);
+
+    std::cout << "Idle emitter footprint: " << sizeof(TestEventEmitter)
+              << " bytes" << std::endl;
+
+    emitters.clear();
+
+    // Any configuration makes emitter active
+    for (std::size_t i = 0; i < ACTIVE_COUNT; ++i) {
+        emitters.emplace_back(at, mem_pool, schema);
+        TestEventEmitter::setMaxListeners(emitters.back(), 4);
+    }
+
+    BOOST_CHECK_GT(mem_pool.used, 0U);
+
+    std::cout << "Active emitter footprint: "
+              << (sizeof(TestEventEmitter) + mem_pool.used / ACTIVE_COUNT)
+              << " bytes" << std::endl;
+
+    emitters.clear();
+    BOOST_CHECK_EQUAL(mem_pool.used, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(churn) // NOLINT
+{
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+    std::vector<int> seen;
+    bool off_in_handler = false;
+
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    tee.register_event<int>(test_event);
+    TestEventEmitter::setMaxListeners(tee, 16);
+
+    std::deque<futoin::IEventEmitter::EventHandler> handlers;
+
+    for (auto i = 0; i < 8; ++i) {
+        handlers.emplace_back([&, i](int) {
+            seen.push_back(i);
+
+            if (off_in_handler) {
+                off_in_handler = false;
+                ee.off(test_event, handlers[2]);
+            }
+        });
+    }
+
+    auto check_seen = [&](std::vector<int> expected) {
+        BOOST_CHECK_EQUAL_COLLECTIONS(
+                seen.begin(), seen.end(), expected.begin(), expected.end());
+        seen.clear();
+    };
+
+    at.immediate([&]() {
+        for (auto& h : handlers) {
+            ee.on(test_event, h);
+        }
+
+        // Removal with pending emit leaves the slot for later compaction
+        ee.emit(test_event, 1);
+
+        for (auto i = 1; i < 8; i += 2) {
+            ee.off(test_event, handlers[i]);
+        }
+
+        ee.emit(test_event, 2);
+    });
+    wait_dispatched();
+    check_seen({0, 2, 4, 6, 0, 2, 4, 6});
+
+    at.immediate([&]() {
+        // Re-subscription keeps order of subscription
+        for (auto i = 1; i < 8; i += 2) {
+            ee.on(test_event, handlers[i]);
+        }
+
+        // Subscription churn while emitting
+        futoin::IEventEmitter::EventHandler temp([](int) {});
+
+        for (auto i = 0; i < 1000; ++i) {
+            ee.on(test_event, temp);
+            ee.emit(test_event, i);
+            ee.off(test_event, temp);
+        }
+    });
+    wait_dispatched();
+    BOOST_CHECK_EQUAL(seen.size(), 8000U);
+    seen.resize(8);
+    check_seen({0, 2, 4, 6, 1, 3, 5, 7});
+
+    at.immediate([&]() {
+        off_in_handler = true;
+        ee.emit(test_event, 3);
+    });
+    wait_dispatched();
+    check_seen({0, 4, 6, 1, 3, 5, 7});
+
+    for (auto i = 0; i < 8; ++i) {
+        if (i != 2) {
+            ee.off(test_event, handlers[i]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(once_churn) // NOLINT
+{
+    const std::size_t ADDERS = 100;
+    const std::size_t ITERATIONS = 10000;
+
+    struct TestData
+    {
+        TestData(futoin::ri::AsyncTool& at) noexcept : tee(at) {}
+
+        TestEventEmitter tee;
+        futoin::IEventEmitter& ee = tee;
+        std::size_t fired{0};
+        std::size_t iterations{0};
+        std::promise<void> done;
+
+        std::deque<futoin::IEventEmitter::EventHandler> handlers;
+        std::deque<futoin::IEventEmitter::EventHandler> once_handlers;
+        std::size_t once_next{0};
+
+        std::function<void(int)> once_add;
+        std::function<void(int)> once;
+        std::function<void()> emit;
+    };
+
+    TestData td(at);
+
+    td.once = [&](int) { ++(td.fired); };
+    td.once_add = [&](int) {
+        auto& fired = td.once_handlers[td.once_next];
+        td.ee.once("TestEvent", fired);
+
+        // Cancelled right away
+        auto& cancelled = td.once_handlers[td.once_next + 1];
+        td.ee.once("TestEvent", cancelled);
+        td.ee.off("TestEvent", cancelled);
+
+        td.once_next += 2;
+        td.once_next %= td.once_handlers.size();
+    };
+
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    td.tee.register_event<int>(test_event);
+    TestEventEmitter::setMaxListeners(td.tee, ADDERS * 4);
+
+    td.emit = [&]() {
+        if (td.iterations++ == ITERATIONS) {
+            td.done.set_value();
+        } else {
+            td.ee.emit(test_event, 123);
+            at.immediate(std::ref(td.emit));
+        }
+    };
+
+    for (std::size_t i = 0; i < ADDERS; ++i) {
+        td.handlers.emplace_back(std::ref(td.once_add));
+        td.ee.on(test_event, td.handlers.back());
+    }
+
+    for (std::size_t i = 0; i < ADDERS * 4; ++i) {
+        td.once_handlers.emplace_back(std::ref(td.once));
+    }
+
+    at.immediate(std::ref(td.emit));
+    td.done.get_future().wait();
+
+    BOOST_CHECK_EQUAL(td.fired, (ITERATIONS - 1) * ADDERS);
+}
+
+BOOST_AUTO_TEST_CASE(once_cancel) // NOLINT
+{
+    CountingMemPool mem_pool;
+    TestEventEmitter tee{at, mem_pool};
+    futoin::IEventEmitter& ee = tee;
+
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    tee.register_event(test_event);
+
+    int fired = 0;
+    int cancelled_fired = 0;
+    TestEventEmitter::EventHandler live([&]() { ++fired; });
+    TestEventEmitter::EventHandler cancelled([&]() { ++cancelled_fired; });
+
+    std::promise<void> done;
+    at.immediate([&]() {
+        // Live one at head keeps cancelled slots behind it
+        ee.once(test_event, live);
+        ee.once(test_event, cancelled);
+        ee.off(test_event, cancelled);
+
+        const auto warm = mem_pool.allocated - mem_pool.deallocated;
+
+        // Over the limit of ring sequence without any emit
+        for (auto i = 0; i < 70000; ++i) {
+            ee.once(test_event, cancelled);
+            ee.off(test_event, cancelled);
+        }
+
+        BOOST_CHECK_EQUAL(mem_pool.allocated - mem_pool.deallocated, warm);
+        BOOST_CHECK_EQUAL(tee.listener_count(test_event), 1U);
+
+        ee.emit(test_event);
+        done.set_value();
+    });
+    done.get_future().wait();
+    wait_at_halt();
+
+    BOOST_CHECK_EQUAL(fired, 1);
+    BOOST_CHECK_EQUAL(cancelled_fired, 0);
+    BOOST_CHECK_EQUAL(tee.listener_count(test_event), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(stress) // NOLINT
+{
+    struct TestData
+    {
+        TestData(futoin::ri::AsyncTool& at) noexcept : tee(at) {}
+
+        TestEventEmitter tee;
+        futoin::IEventEmitter& ee = tee;
+        std::size_t count{0};
+        std::promise<size_t> final_count;
+        bool done{false};
+
+        std::deque<futoin::IEventEmitter::EventHandler> handlers;
+        std::deque<futoin::IEventEmitter::EventHandler> once_handlers;
+        std::size_t once_next{0};
+
+        std::function<void(int)> simple;
+        std::function<void(int)> once_add;
+        static void once() {}
+        std::function<void()> emit;
+    };
+
+    TestData td(at);
+
+    td.simple = [&](int) { ++(td.count); };
+    td.once_add = [&](int) {
+        td.ee.once("TestEvent", td.once_handlers[td.once_next]);
+
+        ++(td.once_next);
+        td.once_next %= td.once_handlers.size();
+    };
+
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    td.tee.register_event<int, futoin::string>(test_event);
+    TestEventEmitter::setMaxListeners(td.tee, 1000);
+
+    td.emit = [&]() {
+        if (td.done) {
+            td.final_count.set_value(td.count);
+        } else {
+            td.ee.emit(test_event, 123, futoin::string{});
+            at.immediate(std::ref(td.emit));
+        }
+    };
+
+    at.immediate([&]() {
+        for (auto i = 0; i < 100; ++i) {
+            td.handlers.emplace_back(std::ref(td.simple));
+            td.ee.on("TestEvent", td.handlers.back());
+
+            td.handlers.emplace_back(std::ref(td.once_add));
+            td.ee.on("TestEvent", td.handlers.back());
+
+            td.once_handlers.emplace_back(&TestData::once);
+            td.once_handlers.emplace_back(&TestData::once);
+        }
+
+        at.deferred(std::chrono::seconds(1), [&]() { td.done = true; });
+
+        td.emit();
+    });
+
+    auto count = td.final_count.get_future().get();
+    std::cout << "Stress count: " << count << std::endl;
+    BOOST_CHECK_GT(count, size_t(1e5));
+}
+
+BOOST_AUTO_TEST_CASE(performance) // NOLINT
+{
+    struct TestData
+    {
+        TestData(futoin::ri::AsyncTool& at) noexcept : tee(at) {}
+
+        TestEventEmitter tee;
+        futoin::IEventEmitter& ee = tee;
+        std::size_t count{0};
+        std::promise<size_t> final_count;
+        bool done{false};
+
+        futoin::IEventEmitter::EventHandler handler;
+
+        std::function<void(int)> simple;
+        std::function<void()> emit;
+    };
+
+    TestData td(at);
+
+    td.simple = [&](int) { ++(td.count); };
+
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    td.tee.register_event<int>(test_event);
+
+    td.emit = [&]() {
+        if (td.done) {
+            td.final_count.set_value(td.count);
+        } else {
+            for (auto i = 0; i < 1000; ++i) {
+                td.ee.emit(test_event, 123);
+            }
+            at.immediate(std::ref(td.emit));
+        }
+    };
+
+    at.immediate([&]() {
+        td.handler = std::ref(td.simple);
+        td.ee.on("TestEvent", td.handler);
+
+        at.deferred(std::chrono::seconds(1), [&]() { td.done = true; });
+
+        td.emit();
+    });
+
+    auto count = td.final_count.get_future().get();
+    std::cout << "Performance count: " << count << std::endl;
+    BOOST_CHECK_GT(count, size_t(1e5));
+}
+
+BOOST_AUTO_TEST_CASE(performance_batch) // NOLINT
+{
+    struct TestData
+    {
+        TestData(futoin::ri::AsyncTool& at) noexcept : tee(at) {}
+
+        TestEventEmitter tee;
+        futoin::IEventEmitter& ee = tee;
+        std::size_t count{0};
+        std::promise<size_t> final_count;
+        bool done{false};
+
+        futoin::IEventEmitter::EventHandler handler;
+
+        std::function<void(int)> simple;
+        std::function<void()> emit;
+    };
+
+    TestData td(at);
+
+    td.simple = [&](int) { ++(td.count); };
+
+    futoin::IEventEmitter::EventType test_event{"TestEvent"};
+    td.tee.register_event<int>(test_event);
+    TestEventEmitter::setDispatchBatch(td.tee, 0);
+
+    td.emit = [&]() {
+        if (td.done) {
+            td.final_count.set_value(td.count);
+        } else {
+            for (auto i = 0; i < 1000; ++i) {
+                td.ee.emit(test_event, 123);
+            }
+            at.immediate(std::ref(td.emit));
+        }
+    };
+
+    at.immediate([&]() {
+        td.handler = std::ref(td.simple);
+        td.ee.on("TestEvent", td.handler);
+
+        at.deferred(std::chrono::seconds(1), [&]() { td.done = true; });
+
+        td.emit();
+    });
+
+    auto count = td.final_count.get_future().get();
+    std::cout << "Batch performance count: " << count << std::endl;
     BOOST_CHECK_GT(count, size_t(1e5));
 }
 
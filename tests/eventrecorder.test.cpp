@@ -0,0 +1,114 @@
+//-----------------------------------------------------------------------------
+//   Copyright 2018 FutoIn Project
+//   Copyright 2018 Andrey Galkin
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//-----------------------------------------------------------------------------
+
+#include <boost/test/unit_test.hpp>
+//---
+#include <cstdio>
+#include <future>
+#include <string>
+#include <vector>
+//---
+#include <futoin/ri/asynctool.hpp>
+#include <futoin/ri/eventemitter.hpp>
+#include <futoin/ri/eventrecorder.hpp>
+
+BOOST_AUTO_TEST_SUITE(eventrecorder) // NOLINT
+
+namespace {
+    struct TestEventEmitter : futoin::ri::EventEmitter
+    {
+        TestEventEmitter(futoin::ri::AsyncTool& at) : EventEmitter(at) {}
+
+        using EventEmitter::register_event;
+    };
+
+    void wait_at_halt(futoin::ri::AsyncTool& at)
+    {
+        for (auto i = 0; i < 2; ++i) {
+            std::promise<void> done;
+            at.immediate([&]() { done.set_value(); });
+            done.get_future().wait();
+        }
+    }
+} // namespace
+
+BOOST_AUTO_TEST_CASE(record_replay) // NOLINT
+{
+    const char* path = "eventrecorder.test.trace";
+    futoin::ri::AsyncTool at;
+
+    {
+        TestEventEmitter tee{at};
+        futoin::IEventEmitter& ee = tee;
+
+        futoin::IEventEmitter::EventType data_event{"DataEvent"};
+        tee.register_event<int, futoin::string>(data_event);
+        futoin::IEventEmitter::EventType tick_event{"TickEvent"};
+        tee.register_event(tick_event);
+
+        futoin::ri::EventRecorder recorder(path);
+        recorder.record<int, futoin::string>(ee, data_event, "data");
+        recorder.record<>(ee, tick_event, "tick");
+
+        at.immediate([&]() {
+            for (auto i = 0; i < 100; ++i) {
+                ee.emit(data_event, i, futoin::string(i, 'x'));
+
+                if ((i % 10) == 0) {
+                    ee.emit(tick_event);
+                }
+            }
+        });
+        wait_at_halt(at);
+
+        BOOST_CHECK_EQUAL(recorder.size(), 110U);
+    }
+
+    TestEventEmitter tee{at};
+    futoin::IEventEmitter& ee = tee;
+
+    futoin::IEventEmitter::EventType data_event{"ReplayedDataEvent"};
+    tee.register_event<int, futoin::string>(data_event);
+
+    std::vector<int> seen;
+    futoin::IEventEmitter::EventHandler handler(
+            [&](int i, const futoin::string& s) {
+                BOOST_CHECK_EQUAL(s.size(), std::size_t(i));
+                seen.push_back(i);
+            });
+    ee.on(data_event, handler);
+
+    {
+        // Not bound "tick" channel is skipped
+        futoin::ri::EventReplay replay(path);
+        replay.bind<int, futoin::string>(ee, data_event, "data");
+        BOOST_CHECK_EQUAL(replay.run(), 100U);
+    }
+
+    wait_at_halt(at);
+
+    BOOST_REQUIRE_EQUAL(seen.size(), 100U);
+
+    for (auto i = 0; i < 100; ++i) {
+        BOOST_CHECK_EQUAL(seen[i], i);
+    }
+
+    ee.off(data_event, handler);
+    std::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END() // NOLINT
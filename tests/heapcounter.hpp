@@ -0,0 +1,32 @@
+//-----------------------------------------------------------------------------
+//   Copyright 2018 FutoIn Project
+//   Copyright 2018 Andrey Galkin
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//-----------------------------------------------------------------------------
+
+#ifndef FUTOIN_RI_TESTS_HEAPCOUNTER_HPP
+#define FUTOIN_RI_TESTS_HEAPCOUNTER_HPP
+//---
+#include <atomic>
+#include <cstddef>
+//---
+
+namespace test {
+    //! Global operator new calls of threads with count_heap set
+    extern std::atomic<std::size_t> heap_allocations;
+    extern thread_local bool count_heap;
+} // namespace test
+
+//---
+#endif // FUTOIN_RI_TESTS_HEAPCOUNTER_HPP
@@ -0,0 +1,68 @@
+//-----------------------------------------------------------------------------
+//   Copyright 2018 FutoIn Project
+//   Copyright 2018 Andrey Galkin
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//-----------------------------------------------------------------------------
+
+#include "heapcounter.hpp"
+//---
+#include <cstdlib>
+#include <new>
+
+// NOTE: separate unit, so the replacement is not inlined into callers
+
+namespace test {
+    std::atomic<std::size_t> heap_allocations{0};
+    thread_local bool count_heap = false;
+} // namespace test
+
+void* operator new(std::size_t size)
+{
+    if (test::count_heap) {
+        ++(test::heap_allocations);
+    }
+
+    auto ptr = std::malloc((size != 0) ? size : 1);
+
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
+
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}